@@ -4,79 +4,101 @@ A Docile Sloth adocilesloth@gmail.com
 
 #include <obs-module.h>
 #include <obs-frontend-api/obs-frontend-api.h>
-#include <thread>
+#include <string.h>
+#include "audio-output.h"
+#include "cue-registry.h"
+#include "decoder.h"
+#include "ducking.h"
+#include "health.h"
+#include "hotkeys.h"
+#include "milestones.h"
+#include "mixer.h"
+#include "resampler.h"
+#include "scene-index.h"
+#include "stats.h"
+#include "timer-wheel.h"
+#include "trace.h"
+#include "worker.h"
+#include <util/platform.h>
 #include <atomic>
-#include <sstream>
+#include <memory>
 #include <mutex>
-
-extern "C"
-{
-	#include "libavcodec/avcodec.h"
-	#include "libavformat/avformat.h"
-	#include "libswresample/swresample.h"
-	#include "SDL.h"
-	#include "SDL_thread.h"
-};
-
-std::mutex audioMutex;
-std::thread st_stt_Thread, st_sto_Thread, rc_stt_Thread, rc_sto_Thread, bf_stt_Thread, bf_sto_Thread, ps_stt_Thread, ps_sto_Thread;
-
-#define	MAX_AUDIO_FRAME_SIZE 192000 // 1 second of 48khz 32bit audio
-static  Uint8 *audio_chunk;
-static  Uint32  audio_len;
-static  Uint8 *audio_pos;
+#include <string>
+#include <vector>
+
+#define DEFAULT_WARM_UP_MS 50
+//cues warmed at once, the other voices stay free for real cues
+#define WARM_UP_BATCH (MIXER_VOICES / 2)
+#define WARM_UP_SLACK_MS 100		//on top of warm_up_ms for a batch to play out
+//OBS waits on unload, so it should be over about as quick as a frame
+#define UNLOAD_DEADLINE_MS 50
+#define UNLOAD_FADE_MS 10
+#define UNLOAD_FADE_TIMEOUT_MS 30		//the fade plus a couple of device periods
+
+static  obs_data_t *srbeep_settings = NULL;
+//mtime of the SRBeep.json the settings are at least as new as, saved with them
+static int64_t settings_file_mtime = 0;
+//Voice armed by a *_STARTING or *_STOPPING event for each cue, -1 if none
+static std::atomic<int> armed_voices[CUE_EVENT_COUNT];
+//The latest cue that came in before the device was open, the worker plays it
+//once it is. A newer one replaces it, a late beep only helps the latest event.
+static std::mutex pending_mutex;
+static bool cue_pending = false;
+static cue_ref pending_cue;
+static std::string pending_label;
+static int pending_event = -1;
+static uint64_t pending_ns = 0;
+
+void obsstudio_srbeep_save_callback(obs_data_t *save_data, bool saving, void *private_data);
+void obsstudio_srbeep_preload_callback(obs_data_t *save_data, bool saving, void *private_data);
+void obsstudio_srbeep_hotkey_callback(void *data, obs_hotkey_id id, obs_hotkey_t *hotkey, bool pressed);
 
 OBS_DECLARE_MODULE()
 
-#ifdef _WIN32
-	#include <windows.h>
-
-	void psleep(unsigned milliseconds)
-	{
-		Sleep(milliseconds);
-	}
-#else
-	#include <unistd.h>
-
-	void psleep(unsigned milliseconds)
-	{
-		usleep(milliseconds * 1000); // takes microseconds
-	}
-#endif
-
 void obs_module_unload(void)
 {
-	if(st_stt_Thread.joinable())
+	uint64_t unload_start = os_gettime_ns();
+	obs_frontend_remove_save_callback(obsstudio_srbeep_save_callback, 0);
+	obs_frontend_remove_preload_callback(obsstudio_srbeep_preload_callback, 0);
+	hotkeys_free();
+	//a decode in flight on the worker gives up at its next check instead of finishing
+	decoder_cancel();
+	timer_wheel_stop();
+	health_shutdown();
+	milestones_shutdown();
+	worker_stop();
 	{
-		st_stt_Thread.join();
+		std::lock_guard<std::mutex> lock(pending_mutex);
+		pending_cue = cue_ref();
+		cue_pending = false;
 	}
-	if(st_sto_Thread.joinable())
+	//nothing can start a cue now, let the ones playing trail off rather than click
+	mixer_fade_out(UNLOAD_FADE_MS, UNLOAD_FADE_TIMEOUT_MS);
+	audio_output_shutdown();
+	//nothing else records now. Writing it is opt in, so it's left out of the unload time.
+	uint64_t trace_ns = 0;
+	if(trace_enabled())
 	{
-		st_sto_Thread.join();
+		uint64_t trace_start = os_gettime_ns();
+		trace_write();
+		trace_ns = os_gettime_ns() - trace_start;
 	}
-	if(rc_stt_Thread.joinable())
+	trace_shutdown();
+	mixer_clear();
+	ducking_stop();
+	cue_registry_free();
+	scene_index_free();
+	obs_data_release(srbeep_settings);
+	srbeep_settings = NULL;
+
+	double unload_ms = (os_gettime_ns() - unload_start - trace_ns) / 1e6;
+	if(unload_ms > UNLOAD_DEADLINE_MS)
 	{
-		rc_stt_Thread.join();
+		blog(LOG_WARNING, "SRBeep: obs_module_unload: Took %.2f ms, over the %d ms deadline", unload_ms, UNLOAD_DEADLINE_MS);
 	}
-	if(rc_sto_Thread.joinable())
-	{
-		rc_sto_Thread.join();
-	}
-	if(bf_stt_Thread.joinable())
-	{
-		bf_stt_Thread.join();
-	}
-	if(bf_sto_Thread.joinable())
-	{
-		bf_sto_Thread.join();
-	}
-	if(ps_stt_Thread.joinable())
-	{
-		ps_stt_Thread.join();
-	}
-	if(ps_sto_Thread.joinable())
+	else
 	{
-		ps_sto_Thread.join();
+		blog(LOG_INFO, "SRBeep: obs_module_unload: Took %.2f ms", unload_ms);
 	}
 	return;
 }
@@ -96,302 +118,488 @@ const char  *obs_module_description(void)
 	return "Adds audio sound when streaming/recording/buffer starts/stops or when recording is paused/unpaused.";
 }
 
-void fill_audio(void *udata, Uint8 *stream, int len)
+//For other plugins and scripts, see srbeep-stats.h
+MODULE_EXPORT void srbeep_get_stats(struct srbeep_stats *stats)
 {
-	/*****************************************************************
-	From simplest_ffmpeg_audio_player by leixiaohua1020
-	Download at https://sourceforge.net/projects/simplestffmpegplayer/
-	*****************************************************************/
-	//SDL 2.0
-	SDL_memset(stream, 0, len);
-	if(audio_len == 0)		/*  Only  play  if  we  have  data  left  */
+	struct srbeep_stats snapshot;
+	stats_read(&snapshot);
+	//a caller built against an older or newer header gets the fields both know
+	uint32_t size = stats->size < sizeof(snapshot) ? stats->size : (uint32_t)sizeof(snapshot);
+	if(size < sizeof(snapshot.size))
+	{
 		return;
-	len = ((unsigned int)len > audio_len ? audio_len : len);	/*  Mix  as  much  data  as  possible  */
-
-	SDL_MixAudio(stream, audio_pos, len, SDL_MIX_MAXVOLUME);
-	audio_pos += len;
-	audio_len -= len;
+	}
+	memcpy(stats, &snapshot, size);
+	stats->size = size;
 }
 
-void play_clip(const char *filepath)
+//Runs on the worker after the device start that pending cues wait for
+void play_pending_cue(void)
 {
-	//fix problems with audio_len being assigned a value
-	static  Uint32  fixer;
-	audio_len = fixer;
-	//carry on
-	/*****************************************************************
-	Adapted from simplest_ffmpeg_audio_player by leixiaohua1020
-	Download at https://sourceforge.net/projects/simplestffmpegplayer/
-	*****************************************************************/
-	AVFormatContext *stream_start = NULL;
-	AVCodec *cdc = nullptr;
-	int audioStreamIndex = -1;
-
-	if(avformat_open_input(&stream_start, filepath, NULL, NULL) != 0)
-	{
-		blog(LOG_WARNING, "SRBeep: play_clip: Failed to open file");
-		blog(LOG_WARNING, filepath);
-		return;
+	cue_ref cue;
+	std::string label;
+	int event;
+	uint64_t requested_ns;
+	{
+		std::lock_guard<std::mutex> lock(pending_mutex);
+		if(!cue_pending)
+		{
+			return;
+		}
+		cue = pending_cue;
+		pending_cue = cue_ref();
+		label.swap(pending_label);
+		event = pending_event;
+		requested_ns = pending_ns;
+		cue_pending = false;
 	}
-
-	if(avformat_find_stream_info(stream_start, NULL) < 0)
+	if(!audio_output_start())
 	{
-		avformat_close_input(&stream_start);
-		blog(LOG_WARNING, "SRBeep: play_clip: Failed to find stream_start_sound.mp3's stream info");
+		stats_cue_dropped();
+		blog(LOG_WARNING, "SRBeep: play_pending_cue: No audio device, dropped cue for %s", label.c_str());
 		return;
 	}
-
-	audioStreamIndex = av_find_best_stream(stream_start, AVMEDIA_TYPE_AUDIO, -1, -1, &cdc, 0);
-	if(audioStreamIndex < 0)
+	if(!mixer_play(cue, requested_ns))
 	{
-		avformat_close_input(&stream_start);
-		blog(LOG_WARNING, "SRBeep: play_clip: Failed to find audio stream in stream_start_sound.mp3");
+		stats_cue_dropped();
+		blog(LOG_WARNING, "SRBeep: play_pending_cue: All voices busy, dropped cue for %s", label.c_str());
 		return;
 	}
-	//get audio stream
-	audioStreamIndex = -1;
-	for(unsigned int i = 0; i < stream_start->nb_streams; i++)
+	if(event >= 0)
 	{
-		if(stream_start->streams[i]->codecpar->codec_type == AVMEDIA_TYPE_AUDIO)
+		stats_cue_played(event);
+	}
+}
+
+//From a picked cue to a voice. True if it is playing, false if it was dropped
+//or waits for the device, which counts it as played for event once it starts.
+bool start_cue(const cue_ref &cue, const char *label, uint64_t requested_ns, int event)
+{
+	//the device is opened on the worker, the event path never waits on SDL
+	if(!audio_output_ready())
+	{
+		bool replaced;
+		std::string replaced_label;
+		{
+			std::lock_guard<std::mutex> lock(pending_mutex);
+			replaced = cue_pending;
+			replaced_label.swap(pending_label);
+			pending_cue = cue;
+			pending_label = label;
+			pending_event = event;
+			pending_ns = requested_ns;
+			cue_pending = true;
+		}
+		if(replaced)
+		{
+			stats_cue_dropped();
+			blog(LOG_WARNING, "SRBeep: start_cue: Audio device not open yet, dropped the cue for %s", replaced_label.c_str());
+		}
+		else
 		{
-			audioStreamIndex = i;
-			break;
+			audio_output_request();
+			worker_post(play_pending_cue);
 		}
+		return false;
 	}
-	//get codec
-	AVCodecContext *cdx = avcodec_alloc_context3(NULL);
-	avcodec_parameters_to_context(cdx, stream_start->streams[audioStreamIndex]->codecpar);
-	AVCodec *codec = avcodec_find_decoder(cdx->codec_id);
-	if(!codec)
+	if(!mixer_play(cue, requested_ns))
 	{
-		blog(LOG_WARNING, "SRBeep: play_clip: Codec not supported");
-		return;
+		stats_cue_dropped();
+		blog(LOG_WARNING, "SRBeep: start_cue: All voices busy, dropped cue for %s", label);
+		return false;
 	}
-	//openm codec
-	avcodec_open2(cdx, codec, NULL);
+	return true;
+}
 
-	//audio packet
-	AVPacket *packet;
-	packet = (AVPacket*)av_malloc(sizeof(AVPacket));
-	av_init_packet(packet);
+void play_cue(cue_event event)
+{
+	trace_scope scope("dispatch", cue_event_key(event));
+	uint64_t requested_ns = os_gettime_ns();
+	stats_cue_requested(event);
+	//armed by the intent event, so it only needs starting
+	int armed = armed_voices[event].exchange(-1);
+	if(armed >= 0 && mixer_fire(armed, requested_ns))
+	{
+		stats_cue_played(event);
+		return;
+	}
 
-	//Audio Parameters
-	uint64_t out_channel_layout = AV_CH_LAYOUT_STEREO;
-	int out_nb_samples = cdx->frame_size;
-	AVSampleFormat out_sample_fmt = AV_SAMPLE_FMT_S16;
-	int out_sample_rate = 44100;
-	int out_channels = av_get_channel_layout_nb_channels(out_channel_layout);
-	//Buffer Size
-	int out_buffer_size = av_samples_get_buffer_size(NULL, out_channels, out_nb_samples, out_sample_fmt, 1);
-	uint8_t *out_buffer = (uint8_t*)av_malloc(MAX_AUDIO_FRAME_SIZE * 2);
-	AVFrame *frame = av_frame_alloc();
+	cue_ref cue;
+	if(!cue_registry_pick(event, &cue))
+	{
+		stats_cue_missing();
+		blog(LOG_WARNING, "SRBeep: play_cue: No sound loaded for %s", cue_event_key(event));
+		return;
+	}
+	if(start_cue(cue, cue_event_key(event), requested_ns, event))
+	{
+		stats_cue_played(event);
+	}
 
-	audioMutex.lock();
+	return;
+}
 
-	//init SDL
-	if(SDL_Init(SDL_INIT_VIDEO | SDL_INIT_AUDIO | SDL_INIT_TIMER))
+//The transition failed or was superseded, give the voice back
+void disarm_cue(cue_event event)
+{
+	int armed = armed_voices[event].exchange(-1);
+	if(armed >= 0)
 	{
-		audioMutex.unlock();
+		mixer_disarm(armed);
+	}
+}
 
-		blog(LOG_WARNING, "SRBEEP: play_clip: SDL init failed");
+//On *_STARTING and *_STOPPING, gets the cue resident in a silent voice and the
+//device awake, so *_STARTED or *_STOPPED only has to flip it on
+void arm_cue(cue_event event)
+{
+	disarm_cue(event);
+	if(!audio_output_ready())
+	{
+		audio_output_request();
+		return;
+	}
+	cue_ref cue;
+	if(!cue_registry_pick(event, &cue))
+	{
 		return;
 	}
+	int voice = mixer_arm(cue);
+	if(voice >= 0)
+	{
+		armed_voices[event].store(voice);
+	}
+}
 
-	SDL_AudioSpec wanted_spec;
-	wanted_spec.freq = cdx->sample_rate;
-	wanted_spec.format = AUDIO_S16SYS;
-	wanted_spec.channels = cdx->channels;
-	wanted_spec.silence = 0;
-	wanted_spec.samples = out_nb_samples;
-	wanted_spec.callback = fill_audio;
-	wanted_spec.userdata = cdx;
+//Hotkeys take the same path as events, so a keypress is heard within a device period
+void play_hotkey(int hotkey)
+{
+	trace_scope scope("dispatch", "hotkey");
+	uint64_t requested_ns = os_gettime_ns();
+	cue_ref cue;
+	if(!cue_registry_pick_hotkey(hotkey, &cue))
+	{
+		stats_cue_missing();
+		blog(LOG_WARNING, "SRBeep: play_hotkey: No sound loaded for hotkey %s", hotkeys_name(hotkey));
+		return;
+	}
+	start_cue(cue, hotkeys_name(hotkey), requested_ns, -1);
+}
 
-	if(SDL_OpenAudio(&wanted_spec, NULL) < 0)
+//Scenes without a cue of their own are silent, that's not worth a warning
+void play_scene(void)
+{
+	uint64_t requested_ns = os_gettime_ns();
+	obs_source_t *scene = obs_frontend_get_current_scene();
+	const char *name = scene ? obs_source_get_name(scene) : NULL;
+	int index = scene_index_find(name);
+	cue_ref cue;
+	if(index >= 0 && cue_registry_pick_scene(index, &cue))
 	{
-		audioMutex.unlock();
+		trace_scope scope("dispatch", "scene");
+		start_cue(cue, name, requested_ns, -1);
+	}
+	obs_source_release(scene);
+}
 
-		blog(LOG_WARNING, "SRBEEP: play_clip: SDL_OpenAudio failed");
+void obsstudio_srbeep_hotkey_callback(void *data, obs_hotkey_id id, obs_hotkey_t *hotkey, bool pressed)
+{
+	if(!pressed)
+	{
 		return;
 	}
+	stats_hotkey_pressed();
+	int index = (int)(intptr_t)data;
+	if(hotkeys_allow(index))
+	{
+		play_hotkey(index);
+	}
+}
 
-	//FIX:Some Codec's Context Information is missing
-	int64_t in_channel_layout;
-	in_channel_layout = av_get_default_channel_layout(cdx->channels);
-	//Swr
-	struct SwrContext *au_convert_ctx;
-	au_convert_ctx = swr_alloc();
-	au_convert_ctx = swr_alloc_set_opts(au_convert_ctx, out_channel_layout, out_sample_fmt, out_sample_rate, in_channel_layout, cdx->sample_fmt, cdx->sample_rate, 0, NULL);
-	swr_init(au_convert_ctx);
+//Settings that are cheap to apply in place
+void apply_light_settings(obs_data_t *settings)
+{
+	ducking_load_settings(settings);
+	health_load_settings(settings);
+	milestones_load_settings(settings);
+	scene_index_rebuild(settings);
+	hotkeys_update(settings, obsstudio_srbeep_hotkey_callback);
+	trace_set_enabled(obs_data_get_bool(settings, "trace_enabled"));
+	decoder_set_limits(obs_data_get_int(settings, "decode_budget_ms"), obs_data_get_int(settings, "max_cue_seconds"));
+	audio_output_set_device(obs_data_get_string(settings, "output_device"));
+	const char *quality = obs_data_get_string(settings, "resample_quality");
+	if(strcmp(quality, "fast") == 0)
+		resampler_set_quality(RESAMPLER_FAST);
+	else if(strcmp(quality, "best") == 0)
+		resampler_set_quality(RESAMPLER_BEST);
+	else
+		resampler_set_quality(RESAMPLER_MEDIUM);
+}
 
-	int ret;
-	int index = 0;
+//Cues are diffed and decoded on the worker
+void load_cues(obs_data_t *settings)
+{
+	//the task owns a reference, released even if worker_stop drops it unrun
+	obs_data_addref(settings);
+	std::shared_ptr<obs_data_t> task_settings(settings, obs_data_release);
+	worker_post([task_settings]{ cue_registry_load(task_settings.get()); });
+}
 
-	while(av_read_frame(stream_start, packet) >= 0)
-	{
-		if(packet->stream_index == audioStreamIndex)
-		{
-			ret = avcodec_send_packet(cdx, packet);
-			if(ret == AVERROR(EAGAIN))
-				ret = 0;
-			if(ret == 0)
-			{
-				ret = avcodec_receive_frame(cdx, frame);
-			}
-			if(ret < 0)
-			{
-				audioMutex.unlock();
+void apply_settings(obs_data_t *settings)
+{
+	obs_data_release(srbeep_settings);
+	obs_data_addref(settings);
+	srbeep_settings = settings;
 
-				blog(LOG_WARNING, "SRBEEP: play_clip: Decoding audio frame error");
-				return;
-			}
-			else
-			{
-				swr_convert(au_convert_ctx, &out_buffer, MAX_AUDIO_FRAME_SIZE, (const uint8_t**)frame->data, frame->nb_samples);
-				index++;
-			}
+	apply_light_settings(settings);
+	load_cues(settings);
+}
 
-			while(audio_len > 0)//Wait until finish
-				SDL_Delay(1);
+//SRBeep.json, or NULL if there isn't one. mtime is 0 then.
+obs_data_t *load_settings_file(int64_t *mtime)
+{
+	char *config_path = obs_module_config_path("SRBeep.json");
+	obs_data_t *settings = NULL;
+	uint64_t size = 0;
+	*mtime = 0;
+	if(config_path && cue_file_stat(config_path, &size, mtime))
+	{
+		settings = obs_data_create_from_json_file_safe(config_path, "bak");
+	}
+	bfree(config_path);
+	return settings;
+}
 
-			//Set audio buffer (PCM data)
-			audio_chunk = (Uint8*)out_buffer;
-			//Audio buffer length
-			audio_len = out_buffer_size;
-			audio_pos = audio_chunk;
+void obsstudio_srbeep_save_callback(obs_data_t *save_data, bool saving, void *private_data)
+{
+	if(saving)
+	{
+		obs_data_set_obj(save_data, "SRBeep", srbeep_settings);
+		obs_data_set_int(save_data, "SRBeep_file_mtime", settings_file_mtime);
+		hotkeys_save_bindings(save_data);
+		return;
+	}
 
-			//Play
+	//SRBeep.json edited since the collection was saved wins over its copy
+	int64_t file_mtime = 0;
+	obs_data_t *settings = load_settings_file(&file_mtime);
+	if(settings && file_mtime > obs_data_get_int(save_data, "SRBeep_file_mtime"))
+	{
+		settings_file_mtime = file_mtime;
+	}
+	else
+	{
+		obs_data_release(settings);
+		settings = obs_data_get_obj(save_data, "SRBeep");
+		settings_file_mtime = obs_data_get_int(save_data, "SRBeep_file_mtime");
+	}
+	//the preload callback has usually applied these already
+	if(settings && strcmp(obs_data_get_json(settings), obs_data_get_json(srbeep_settings)) != 0)
+	{
+		apply_settings(settings);
+	}
+	obs_data_release(settings);
+	//after the settings, so every hotkey they name is registered
+	hotkeys_load_bindings(save_data);
+}
 
-			SDL_PauseAudio(0);
-		}
+void obsstudio_srbeep_preload_callback(obs_data_t *save_data, bool saving, void *private_data)
+{
+	if(!saving)
+	{
+		obsstudio_srbeep_save_callback(save_data, false, private_data);
 	}
-	av_packet_free(&packet);
-	swr_free(&au_convert_ctx);
-	//Close SDL
-	SDL_CloseAudio();
-	SDL_Quit();
-	//clean up
-	av_free(out_buffer);
-	avcodec_close(cdx);
-	av_frame_free(&frame);
-	avformat_close_input(&stream_start);
-	avcodec_free_context(&cdx);
-	audioMutex.unlock();
-	return;
 }
 
-std::string clean_path(std::string audio_path)
+//Decodes the cue set for the new profile or scene collection off the UI thread
+void prefetch_cue_set(void)
+{
+	char *profile = obs_frontend_get_current_profile();
+	char *collection = obs_frontend_get_current_scene_collection();
+	std::string profile_name = profile ? profile : "";
+	std::string collection_name = collection ? collection : "";
+	bfree(profile);
+	bfree(collection);
+
+	worker_post([profile_name, collection_name]{ cue_registry_activate(profile_name, collection_name); });
+}
+
+//Runs on the worker once OBS has loaded, so the first real cue doesn't pay for
+//a device that hasn't called back yet, cold caches or page faults. Opening the
+//device here only happens if it failed at load.
+void warm_up_cues(uint32_t warm_up_ms)
 {
-	std::string cleaned_path;
-	//If relative path then the first 2 chars should be ".."
-	if(audio_path.find("..") != std::string::npos)
+	trace_scope scope("warm_up");
+	if(!audio_output_start())
 	{
-		size_t pos = audio_path.find("..");
-		cleaned_path = audio_path.substr(pos);
+		return;
 	}
-	//If absolute path, Windows will start with a capital, Linux/Mac will start with "/"
-	else
+	std::vector<cue_ref> cues;
+	cue_registry_current(cues);
+	uint32_t frames = warm_up_ms * CUE_SAMPLE_RATE / 1000;
+	size_t skipped = 0;
+	for(size_t batch = 0; batch < cues.size() && !decoder_cancelled(); batch += WARM_UP_BATCH)
 	{
-		#ifdef _WIN32
-			while(islower(audio_path[0]) && audio_path.length() > 0)
-			{
-				audio_path = audio_path.substr(1);
-			}
-		#else
-			while(audio_path.substr(0, 1) != "/" && audio_path.length() > 0)
+		size_t end = batch + WARM_UP_BATCH < cues.size() ? batch + WARM_UP_BATCH : cues.size();
+		for(size_t i = batch; i < end; i++)
+		{
+			if(!mixer_warm_up(cues[i], frames))
 			{
-				audio_path = audio_path.substr(1);
+				skipped++;
 			}
-		#endif
-		cleaned_path = audio_path;
+		}
+		//the next batch needs these voices back
+		uint64_t give_up_ns = os_gettime_ns() + (uint64_t)(warm_up_ms + WARM_UP_SLACK_MS) * 1000000;
+		while(mixer_warming_up() > 0 && os_gettime_ns() < give_up_ns && !decoder_cancelled())
+		{
+			os_sleep_ms(5);
+		}
+	}
+	if(skipped)
+	{
+		blog(LOG_WARNING, "SRBeep: warm_up_cues: %d of %d cues not warmed, every voice was busy", (int)skipped, (int)cues.size());
 	}
-	return cleaned_path;
 }
 
-void play_sound(std::string file_name)
+void obsstudio_srbeep_write_trace(void *private_data)
 {
-	const char *obs_data_path = obs_get_module_data_path(obs_current_module());
-	std::stringstream audio_path;
-	std::string true_path;
-
-	audio_path << obs_data_path;
-	audio_path << file_name;
-	true_path = clean_path(audio_path.str());
-	play_clip(true_path.c_str());
-	audio_path.str("");
-
-	return;
+	trace_write();
 }
 
 void obsstudio_srbeep_frontend_event_callback(enum obs_frontend_event event, void *private_data)
 {
-	if(event == OBS_FRONTEND_EVENT_STREAMING_STARTED)
+	if(event == OBS_FRONTEND_EVENT_STREAMING_STARTING)
 	{
-		if(st_stt_Thread.joinable())
-		{
-			st_stt_Thread.join();
-		}
-		st_stt_Thread = std::thread(play_sound, "/stream_start_sound.mp3");
+		arm_cue(CUE_STREAM_START);
+	}
+	else if(event == OBS_FRONTEND_EVENT_RECORDING_STARTING)
+	{
+		arm_cue(CUE_RECORD_START);
+	}
+	else if(event == OBS_FRONTEND_EVENT_REPLAY_BUFFER_STARTING)
+	{
+		arm_cue(CUE_BUFFER_START);
+	}
+	else if(event == OBS_FRONTEND_EVENT_STREAMING_STOPPING)
+	{
+		//a stream winding down drops frames, that's not worth an alarm
+		health_stop();
+		milestones_stop(MILESTONE_STREAMING);
+		arm_cue(CUE_STREAM_STOP);
+	}
+	else if(event == OBS_FRONTEND_EVENT_RECORDING_STOPPING)
+	{
+		milestones_stop(MILESTONE_RECORDING);
+		arm_cue(CUE_RECORD_STOP);
+	}
+	else if(event == OBS_FRONTEND_EVENT_REPLAY_BUFFER_STOPPING)
+	{
+		arm_cue(CUE_BUFFER_STOP);
+	}
+	else if(event == OBS_FRONTEND_EVENT_STREAMING_STARTED)
+	{
+		play_cue(CUE_STREAM_START);
+		health_start(obs_frontend_get_streaming_output(), play_cue);
+		milestones_start(MILESTONE_STREAMING, play_cue);
 	}
 	else if(event == OBS_FRONTEND_EVENT_RECORDING_STARTED)
 	{
-		if (rc_stt_Thread.joinable())
-		{
-			rc_stt_Thread.join();
-		}
-		rc_stt_Thread = std::thread(play_sound, "/record_start_sound.mp3");
+		play_cue(CUE_RECORD_START);
+		milestones_start(MILESTONE_RECORDING, play_cue);
 	}
 	else if(event == OBS_FRONTEND_EVENT_REPLAY_BUFFER_STARTED)
 	{
-		if(bf_stt_Thread.joinable())
-		{
-			bf_stt_Thread.join();
-		}
-		bf_stt_Thread = std::thread(play_sound, "/buffer_start_sound.mp3");
+		play_cue(CUE_BUFFER_START);
 	}
 	else if(event == OBS_FRONTEND_EVENT_RECORDING_PAUSED)
 	{
-		if(ps_stt_Thread.joinable())
-		{
-			ps_stt_Thread.join();
-		}
-		ps_stt_Thread = std::thread(play_sound, "/pause_start_sound.mp3");
+		milestones_pause(MILESTONE_RECORDING, true);
+		play_cue(CUE_PAUSE_START);
 	}
+	//a STOPPED with the start cue still armed means the start failed
 	else if(event == OBS_FRONTEND_EVENT_STREAMING_STOPPED)
 	{
-		if(st_sto_Thread.joinable())
-		{
-			st_sto_Thread.join();
-		}
-		st_sto_Thread = std::thread(play_sound, "/stream_stop_sound.mp3");
+		health_stop();
+		milestones_stop(MILESTONE_STREAMING);
+		disarm_cue(CUE_STREAM_START);
+		play_cue(CUE_STREAM_STOP);
 	}
 	else if(event == OBS_FRONTEND_EVENT_RECORDING_STOPPED)
 	{
-		if(rc_sto_Thread.joinable())
-		{
-			rc_sto_Thread.join();
-		}
-		rc_sto_Thread = std::thread(play_sound, "/record_stop_sound.mp3");
+		milestones_stop(MILESTONE_RECORDING);
+		disarm_cue(CUE_RECORD_START);
+		play_cue(CUE_RECORD_STOP);
 	}
 	else if(event == OBS_FRONTEND_EVENT_REPLAY_BUFFER_STOPPED)
 	{
-		if(bf_sto_Thread.joinable())
-		{
-			bf_sto_Thread.join();
-		}
-		bf_sto_Thread = std::thread(play_sound, "/buffer_stop_sound.mp3");
+		disarm_cue(CUE_BUFFER_START);
+		play_cue(CUE_BUFFER_STOP);
 	}
 	else if(event == OBS_FRONTEND_EVENT_RECORDING_UNPAUSED)
 	{
-		if(ps_stt_Thread.joinable())
+		milestones_pause(MILESTONE_RECORDING, false);
+		play_cue(CUE_PAUSE_STOP);
+	}
+	else if(event == OBS_FRONTEND_EVENT_EXIT)
+	{
+		stats_log();
+	}
+	else if(event == OBS_FRONTEND_EVENT_SCENE_CHANGED)
+	{
+		play_scene();
+	}
+	else if(event == OBS_FRONTEND_EVENT_SCENE_LIST_CHANGED)
+	{
+		scene_index_rebuild(srbeep_settings);
+	}
+	else if(event == OBS_FRONTEND_EVENT_SCENE_COLLECTION_CHANGED)
+	{
+		scene_index_rebuild(srbeep_settings);
+		prefetch_cue_set();
+	}
+	else if(event == OBS_FRONTEND_EVENT_PROFILE_CHANGED)
+	{
+		prefetch_cue_set();
+	}
+	else if(event == OBS_FRONTEND_EVENT_FINISHED_LOADING)
+	{
+		scene_index_rebuild(srbeep_settings);
+		prefetch_cue_set();
+		//queued behind the prefetch, so the set it warms is the one in use
+		if(obs_data_get_bool(srbeep_settings, "warm_up"))
 		{
-			ps_stt_Thread.join();
+			long long warm_up_ms = obs_data_get_int(srbeep_settings, "warm_up_ms");
+			uint32_t ms = warm_up_ms > 0 && warm_up_ms < 1000 ? (uint32_t)warm_up_ms : DEFAULT_WARM_UP_MS;
+			worker_post([ms]{ warm_up_cues(ms); });
 		}
-		ps_stt_Thread = std::thread(play_sound, "/pause_stop_sound.mp3");
 	}
 }
 
 bool obs_module_load(void)
 {
+	//SRBeep.json gives the settings until a scene collection with its own is loaded
+	srbeep_settings = load_settings_file(&settings_file_mtime);
+	if(!srbeep_settings)
+	{
+		srbeep_settings = obs_data_create();
+	}
+	for(int event = 0; event < CUE_EVENT_COUNT; event++)
+	{
+		armed_voices[event] = -1;
+	}
+	timer_wheel_start();
+	apply_light_settings(srbeep_settings);
+	worker_start();
+	//SDL init, the device open and decoding every cue take a while, so they
+	//happen on the worker well before the first cue
+	audio_output_request();
+	load_cues(srbeep_settings);
+
+	obs_frontend_add_preload_callback(obsstudio_srbeep_preload_callback, 0);
+	obs_frontend_add_save_callback(obsstudio_srbeep_save_callback, 0);
+
 	obs_frontend_add_event_callback(obsstudio_srbeep_frontend_event_callback, 0);
+	obs_frontend_add_tools_menu_item("SRBeep: Write Trace", obsstudio_srbeep_write_trace, 0);
+	trace_set_thread_name("OBS frontend");
 	return true;
 }
@@ -0,0 +1,119 @@
+/***********************************
+A Docile Sloth adocilesloth@gmail.com
+************************************/
+
+#include "adpcm.h"
+#include <string.h>
+
+static const int16_t step_table[89] =
+{
+	7, 8, 9, 10, 11, 12, 13, 14, 16, 17, 19, 21, 23, 25, 28, 31, 34, 37, 41, 45,
+	50, 55, 60, 66, 73, 80, 88, 97, 107, 118, 130, 143, 157, 173, 190, 209, 230,
+	253, 279, 307, 337, 371, 408, 449, 494, 544, 598, 658, 724, 796, 876, 963,
+	1060, 1166, 1282, 1411, 1552, 1707, 1878, 2066, 2272, 2499, 2749, 3024, 3327,
+	3660, 4026, 4428, 4871, 5358, 5894, 6484, 7132, 7845, 8630, 9493, 10442,
+	11487, 12635, 13899, 15289, 16818, 18500, 20350, 22385, 24623, 27086, 29794,
+	32767
+};
+
+static const int8_t index_table[8] = {-1, -1, -1, -1, 2, 4, 6, 8};
+
+struct adpcm_state
+{
+	int predictor;
+	int index;
+};
+
+//The encoder runs this too, so both sides track the same state
+static int decode_nibble(adpcm_state &state, uint8_t nibble)
+{
+	int step = step_table[state.index];
+	int delta = step >> 3;
+	if(nibble & 4)
+		delta += step;
+	if(nibble & 2)
+		delta += step >> 1;
+	if(nibble & 1)
+		delta += step >> 2;
+	state.predictor += (nibble & 8) ? -delta : delta;
+	state.predictor = state.predictor > 32767 ? 32767 : (state.predictor < -32768 ? -32768 : state.predictor);
+	state.index += index_table[nibble & 7];
+	state.index = state.index < 0 ? 0 : (state.index > 88 ? 88 : state.index);
+	return state.predictor;
+}
+
+static uint8_t encode_sample(adpcm_state &state, int sample)
+{
+	int step = step_table[state.index];
+	int diff = sample - state.predictor;
+	uint8_t nibble = 0;
+	if(diff < 0)
+	{
+		nibble = 8;
+		diff = -diff;
+	}
+	if(diff >= step)
+	{
+		nibble |= 4;
+		diff -= step;
+	}
+	if(diff >= step >> 1)
+	{
+		nibble |= 2;
+		diff -= step >> 1;
+	}
+	if(diff >= step >> 2)
+	{
+		nibble |= 1;
+	}
+	decode_nibble(state, nibble);
+	return nibble;
+}
+
+void adpcm_encode(const int16_t *samples, uint32_t frames, std::vector<adpcm_block> &blocks)
+{
+	adpcm_state states[CUE_CHANNELS];
+	for(int channel = 0; channel < CUE_CHANNELS; channel++)
+	{
+		states[channel].predictor = 0;
+		states[channel].index = 0;
+	}
+
+	blocks.resize((frames + ADPCM_BLOCK_FRAMES - 1) / ADPCM_BLOCK_FRAMES);
+	for(size_t b = 0; b < blocks.size(); b++)
+	{
+		adpcm_block &block = blocks[b];
+		memset(block.data, 0, sizeof(block.data));
+		for(int channel = 0; channel < CUE_CHANNELS; channel++)
+		{
+			block.predictor[channel] = (int16_t)states[channel].predictor;
+			block.step_index[channel] = (uint8_t)states[channel].index;
+		}
+		for(uint32_t frame = 0; frame < ADPCM_BLOCK_FRAMES; frame++)
+		{
+			size_t source = b * ADPCM_BLOCK_FRAMES + frame;
+			for(int channel = 0; channel < CUE_CHANNELS; channel++)
+			{
+				int sample = source < frames ? samples[source * CUE_CHANNELS + channel] : 0;
+				uint8_t nibble = encode_sample(states[channel], sample);
+				uint32_t at = frame * CUE_CHANNELS + channel;
+				block.data[at / 2] |= (at & 1) ? (uint8_t)(nibble << 4) : nibble;
+			}
+		}
+	}
+}
+
+void adpcm_decode_block(const adpcm_block &block, int16_t *out)
+{
+	adpcm_state states[CUE_CHANNELS];
+	for(int channel = 0; channel < CUE_CHANNELS; channel++)
+	{
+		states[channel].predictor = block.predictor[channel];
+		states[channel].index = block.step_index[channel];
+	}
+	for(uint32_t at = 0; at < ADPCM_BLOCK_FRAMES * CUE_CHANNELS; at++)
+	{
+		uint8_t nibble = (at & 1) ? block.data[at / 2] >> 4 : block.data[at / 2] & 0x0f;
+		out[at] = (int16_t)decode_nibble(states[at % CUE_CHANNELS], nibble);
+	}
+}
@@ -0,0 +1,27 @@
+/***********************************
+A Docile Sloth adocilesloth@gmail.com
+************************************/
+
+#pragma once
+
+#include <stdint.h>
+#include <vector>
+#include "decoder.h"
+
+//IMA ADPCM, 4 bits a sample, for keeping large cue libraries compressed in
+//memory. Each block carries the coder state it starts from, so any block
+//decodes on its own and the mixer only ever needs the one it is reading.
+
+#define ADPCM_BLOCK_FRAMES 256
+
+struct adpcm_block
+{
+	int16_t predictor[CUE_CHANNELS];
+	uint8_t step_index[CUE_CHANNELS];
+	uint8_t data[ADPCM_BLOCK_FRAMES * CUE_CHANNELS / 2];	//interleaved nibbles, low nibble first
+};
+
+//Encodes interleaved cue PCM, the last block is padded with silence
+void adpcm_encode(const int16_t *samples, uint32_t frames, std::vector<adpcm_block> &blocks);
+//Decodes one block into ADPCM_BLOCK_FRAMES interleaved frames, safe from the audio callback
+void adpcm_decode_block(const adpcm_block &block, int16_t *out);
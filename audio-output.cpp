@@ -0,0 +1,255 @@
+/***********************************
+A Docile Sloth adocilesloth@gmail.com
+************************************/
+
+#include "audio-output.h"
+#include "decoder.h"
+#include "mixer.h"
+#include "stats.h"
+#include "trace.h"
+#include "worker.h"
+#include <obs.h>
+#include <util/platform.h>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+
+extern "C"
+{
+	#include "SDL.h"
+};
+
+#define OUTPUT_PERIOD_FRAMES 512	//~10.7ms at 48kHz
+
+static std::mutex output_mutex;
+static bool sdl_audio_ready = false;
+static std::atomic<bool> output_open(false);
+static std::atomic<bool> start_queued(false);
+static SDL_AudioDeviceID output_device = 0;
+static std::string output_device_name;		//what output_device was opened as, empty for default
+static std::string wanted_device_name;
+static std::vector<std::string> output_devices;
+
+//Only touched by the audio callback
+static uint64_t last_callback_ns = 0;
+static bool last_callback_active = false;
+
+static void output_callback(void *userdata, Uint8 *stream, int len)
+{
+	//SDL doesn't report xruns, a callback more than two periods late while a
+	//cue was playing is counted as one
+	trace_set_thread_name("SDL audio");
+	uint64_t now = os_gettime_ns();
+	uint64_t period_ns = (uint64_t)OUTPUT_PERIOD_FRAMES * 1000000000ULL / CUE_SAMPLE_RATE;
+	if(last_callback_active && last_callback_ns && now - last_callback_ns > 2 * period_ns)
+	{
+		stats_underrun();
+	}
+	last_callback_ns = now;
+	last_callback_active = mixer_render((int16_t*)stream, len / (CUE_CHANNELS * sizeof(int16_t)));
+}
+
+static void enumerate_devices(void)
+{
+	output_devices.clear();
+	int count = SDL_GetNumAudioDevices(0);
+	for(int i = 0; i < count; i++)
+	{
+		const char *name = SDL_GetAudioDeviceName(i, 0);
+		if(name)
+		{
+			output_devices.push_back(name);
+			blog(LOG_INFO, "SRBeep: enumerate_devices: Output device \"%s\"", name);
+		}
+	}
+}
+
+//SDL calls this from whichever thread noticed the change, hand it to the worker
+static int SDLCALL device_event_watch(void *userdata, SDL_Event *event)
+{
+	if((event->type == SDL_AUDIODEVICEADDED || event->type == SDL_AUDIODEVICEREMOVED) && !event->adevice.iscapture)
+	{
+		worker_post(audio_output_refresh);
+	}
+	return 0;
+}
+
+//The configured device if it is plugged in, otherwise the default
+static std::string target_device_name(void)
+{
+	for(size_t i = 0; i < output_devices.size(); i++)
+	{
+		if(output_devices[i] == wanted_device_name)
+		{
+			return wanted_device_name;
+		}
+	}
+	return "";
+}
+
+//Expects output_mutex to be held
+static SDL_AudioDeviceID open_device(const std::string &name)
+{
+	//SDL converts if the device wants something else
+	SDL_AudioSpec wanted_spec;
+	SDL_memset(&wanted_spec, 0, sizeof(wanted_spec));
+	wanted_spec.freq = CUE_SAMPLE_RATE;
+	wanted_spec.format = AUDIO_S16SYS;
+	wanted_spec.channels = CUE_CHANNELS;
+	wanted_spec.samples = OUTPUT_PERIOD_FRAMES;
+	wanted_spec.callback = output_callback;
+
+	SDL_AudioDeviceID device = SDL_OpenAudioDevice(name.empty() ? NULL : name.c_str(), 0, &wanted_spec, NULL, 0);
+	if(!device)
+	{
+		blog(LOG_WARNING, "SRBeep: open_device: SDL_OpenAudioDevice failed for %s: %s",
+			name.empty() ? "default device" : name.c_str(), SDL_GetError());
+	}
+	return device;
+}
+
+bool audio_output_start(void)
+{
+	if(output_open.load(std::memory_order_acquire))
+	{
+		return true;
+	}
+
+	std::lock_guard<std::mutex> lock(output_mutex);
+	if(output_device)
+	{
+		return true;
+	}
+	if(!sdl_audio_ready)
+	{
+		//the events subsystem carries device hotplug, it doesn't touch the display
+		if(SDL_InitSubSystem(SDL_INIT_AUDIO | SDL_INIT_EVENTS) != 0)
+		{
+			blog(LOG_WARNING, "SRBeep: audio_output_start: SDL audio init failed: %s", SDL_GetError());
+			return false;
+		}
+		sdl_audio_ready = true;
+		enumerate_devices();
+		SDL_AddEventWatch(device_event_watch, NULL);
+	}
+
+	trace_scope scope("device_open");
+	std::string name = target_device_name();
+	output_device = open_device(name);
+	if(!output_device)
+	{
+		stats_device_failure();
+		return false;
+	}
+	output_device_name = name;
+	SDL_PauseAudioDevice(output_device, 0);
+	output_open.store(true, std::memory_order_release);
+	return true;
+}
+
+bool audio_output_ready(void)
+{
+	return output_open.load(std::memory_order_acquire);
+}
+
+void audio_output_request(void)
+{
+	if(output_open.load(std::memory_order_acquire) || start_queued.exchange(true))
+	{
+		return;
+	}
+	worker_post([]{ start_queued = false; audio_output_start(); });
+}
+
+void audio_output_set_device(const std::string &name)
+{
+	{
+		std::lock_guard<std::mutex> lock(output_mutex);
+		if(wanted_device_name == name)
+		{
+			return;
+		}
+		wanted_device_name = name;
+		if(!output_device)
+		{
+			return;
+		}
+	}
+	worker_post(audio_output_refresh);
+}
+
+void audio_output_refresh(void)
+{
+	std::lock_guard<std::mutex> lock(output_mutex);
+	if(!sdl_audio_ready)
+	{
+		return;
+	}
+	//nobody reads the queue, the watch already saw these
+	SDL_FlushEvents(SDL_AUDIODEVICEADDED, SDL_AUDIODEVICEREMOVED);
+	enumerate_devices();
+	if(!output_device)
+	{
+		return;
+	}
+
+	//a lost device stops calling back, one that is still there and wanted stays.
+	//The default is always reopened so a newly plugged in default is followed.
+	std::string name = target_device_name();
+	bool lost = SDL_GetAudioDeviceStatus(output_device) == SDL_AUDIO_STOPPED;
+	if(!lost && !name.empty() && name == output_device_name)
+	{
+		return;
+	}
+
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	SDL_AudioDeviceID device = open_device(name);
+	if(!device)
+	{
+		return;
+	}
+	//the voices live in the mixer, so pausing the old device waits out its
+	//callback and the new one picks up exactly where it stopped
+	SDL_PauseAudioDevice(output_device, 1);
+	SDL_PauseAudioDevice(device, 0);
+	SDL_CloseAudioDevice(output_device);
+	output_device = device;
+	output_device_name = name;
+
+	long long micros = (long long)std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+	blog(LOG_INFO, "SRBeep: audio_output_refresh: Moved output to %s in %lld us",
+		name.empty() ? "default device" : name.c_str(), micros);
+}
+
+std::vector<std::string> audio_output_devices(void)
+{
+	std::lock_guard<std::mutex> lock(output_mutex);
+	return output_devices;
+}
+
+void audio_output_shutdown(void)
+{
+	std::lock_guard<std::mutex> lock(output_mutex);
+	output_open = false;
+	if(sdl_audio_ready)
+	{
+		SDL_DelEventWatch(device_event_watch, NULL);
+	}
+	if(output_device)
+	{
+		SDL_CloseAudioDevice(output_device);
+		output_device = 0;
+	}
+	if(sdl_audio_ready)
+	{
+		//the same subsystems audio_output_start brought up, or their counts never reach zero
+		SDL_QuitSubSystem(SDL_INIT_AUDIO | SDL_INIT_EVENTS);
+		sdl_audio_ready = false;
+		//leave SDL alone if something else in the process still uses it
+		if(SDL_WasInit(SDL_INIT_EVERYTHING) == 0)
+		{
+			SDL_Quit();
+		}
+	}
+	output_devices.clear();
+}
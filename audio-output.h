@@ -0,0 +1,31 @@
+/***********************************
+A Docile Sloth adocilesloth@gmail.com
+************************************/
+
+#pragma once
+
+#include <string>
+#include <vector>
+
+//The SDL side. Only the audio subsystem (and its hotplug events) is
+//initialised, once, on the worker when the plugin loads. The device then stays
+//open and the mixer feeds it, moving to another device when one is plugged in
+//or removed without losing the voices that are playing.
+
+//Opens the device if it isn't already, cheap once it is. SDL init and the open
+//are slow, so only the worker calls it.
+bool audio_output_start(void);
+//True once the device is open, never blocks, for the event path
+bool audio_output_ready(void);
+//Queues audio_output_start on the worker, unless the device is open or a start
+//is queued already
+void audio_output_request(void);
+//Output device by name, empty for the system default. Takes effect at once
+//if the device is open.
+void audio_output_set_device(const std::string &name);
+//Re-enumerates and moves to the wanted device if needed, run on the worker
+void audio_output_refresh(void);
+//Output device names, enumerated once when SDL audio comes up
+std::vector<std::string> audio_output_devices(void);
+//Closes the device and shuts SDL audio down, only at module unload
+void audio_output_shutdown(void);
@@ -0,0 +1,509 @@
+/***********************************
+A Docile Sloth adocilesloth@gmail.com
+************************************/
+
+#include "cue-cache.h"
+#include "decoder.h"
+#include "stats.h"
+#include <obs.h>
+#include <atomic>
+#include <chrono>
+#include <string.h>
+#include <sys/stat.h>
+#include <thread>
+
+#ifndef _WIN32
+	#include <errno.h>
+	#include <fcntl.h>
+	#include <signal.h>
+	#include <sys/mman.h>
+	#include <time.h>
+	#include <unistd.h>
+#endif
+
+#define CUE_CACHE_MAGIC 0x53524250		//"SRBP"
+#define CUE_CACHE_VERSION 2
+#define CUE_CACHE_MAX_ENTRIES 32
+#define CUE_CACHE_NAME_LEN 64
+#define CUE_CACHE_WAIT_MS 2000
+
+struct cue_cache_entry
+{
+	char name[CUE_CACHE_NAME_LEN];
+	uint64_t file_size;
+	int64_t file_mtime;
+	uint64_t offset;		//from the start of the segment
+	uint32_t frames;
+	uint32_t reserved;
+};
+
+struct cue_cache_header
+{
+	uint32_t magic;
+	uint32_t version;
+	std::atomic<uint32_t> ready;	//set last by the instance that fills the segment
+	uint32_t writer_pid;			//set first, so a segment whose writer died can be removed
+	uint32_t entry_count;
+	uint32_t sample_rate;
+	uint32_t channels;
+	uint64_t total_size;
+	cue_cache_entry entries[CUE_CACHE_MAX_ENTRIES];
+};
+
+struct cue_slot
+{
+	std::string name;
+	std::string path;
+	uint64_t file_size;
+	int64_t file_mtime;
+	cue_pcm pcm;
+	std::vector<int16_t> local;		//only used when not backed by shared memory
+};
+
+//One set of cached cues. Sets that picked cues from an older generation keep
+//it alive until they are done with it.
+struct cue_generation
+{
+	std::vector<cue_slot> slots;
+	void *shared_base;
+	size_t shared_size;
+	std::string shared_name;		//segment for this set of cues, whether or not it was shared
+
+	cue_generation() : shared_base(NULL), shared_size(0) {}
+	~cue_generation();
+};
+typedef std::shared_ptr<cue_generation> cue_generation_ptr;
+
+static cue_generation_ptr cache;
+
+bool cue_file_stat(const std::string &path, uint64_t *size, int64_t *mtime)
+{
+	struct stat info;
+	if(stat(path.c_str(), &info) != 0)
+	{
+		return false;
+	}
+	*size = (uint64_t)info.st_size;
+	*mtime = (int64_t)info.st_mtime;
+	return true;
+}
+
+#ifndef _WIN32
+//FNV-1a
+static uint32_t hash_bytes(uint32_t hash, const void *data, size_t size)
+{
+	const uint8_t *bytes = (const uint8_t*)data;
+	for(size_t i = 0; i < size; i++)
+	{
+		hash ^= bytes[i];
+		hash *= 16777619u;
+	}
+	return hash;
+}
+
+//One segment per set of cues, so instances loading different sounds don't
+//replace each other's. Kept short for systems that cap the name at 31 chars.
+static std::string segment_name(const cue_generation &gen)
+{
+	uint32_t hash = 2166136261u;
+	for(size_t i = 0; i < gen.slots.size(); i++)
+	{
+		const cue_slot &slot = gen.slots[i];
+		hash = hash_bytes(hash, slot.name.c_str(), slot.name.size() + 1);
+		hash = hash_bytes(hash, slot.path.c_str(), slot.path.size() + 1);
+		hash = hash_bytes(hash, &slot.file_size, sizeof(slot.file_size));
+		hash = hash_bytes(hash, &slot.file_mtime, sizeof(slot.file_mtime));
+	}
+	char name[64];
+	snprintf(name, sizeof(name), "/srbeep-cues-v%d-%u-%08x", CUE_CACHE_VERSION, (unsigned)getuid(), hash);
+	return name;
+}
+
+enum segment_state
+{
+	SEGMENT_MISSING,
+	SEGMENT_MAPPED,
+	SEGMENT_STALE		//its writer died or gave up before marking it ready
+};
+
+//Filling a segment is only a copy of cues decoded beforehand, so one that is
+//still unfinished after the wait never will be
+static bool segment_expired(const struct stat &info)
+{
+	return time(NULL) - info.st_ctime > CUE_CACHE_WAIT_MS / 1000 + 1;
+}
+
+static bool writer_gone(const cue_cache_header *header)
+{
+	pid_t pid = (pid_t)header->writer_pid;
+	return pid > 0 && kill(pid, 0) != 0 && errno == ESRCH;
+}
+
+//Maps an existing segment read only and waits for its writer to finish
+static segment_state map_segment(const std::string &name, cue_generation &gen, const cue_cache_header **header)
+{
+	*header = NULL;
+	int fd = shm_open(name.c_str(), O_RDONLY, 0);
+	if(fd < 0)
+	{
+		return SEGMENT_MISSING;
+	}
+
+	//the writer sizes the segment straight after creating it
+	struct stat info;
+	int waited = 0;
+	for(;;)
+	{
+		if(fstat(fd, &info) != 0)
+		{
+			close(fd);
+			return SEGMENT_MISSING;
+		}
+		if((size_t)info.st_size >= sizeof(cue_cache_header))
+		{
+			break;
+		}
+		if(decoder_cancelled())
+		{
+			close(fd);
+			return SEGMENT_MISSING;
+		}
+		if(waited >= CUE_CACHE_WAIT_MS || segment_expired(info))
+		{
+			close(fd);
+			return SEGMENT_STALE;
+		}
+		std::this_thread::sleep_for(std::chrono::milliseconds(5));
+		waited += 5;
+	}
+
+	void *base = mmap(NULL, info.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if(base == MAP_FAILED)
+	{
+		return SEGMENT_MISSING;
+	}
+
+	const cue_cache_header *candidate = (const cue_cache_header*)base;
+	while(candidate->ready.load(std::memory_order_acquire) == 0)
+	{
+		if(decoder_cancelled())
+		{
+			munmap(base, info.st_size);
+			return SEGMENT_MISSING;
+		}
+		if(waited >= CUE_CACHE_WAIT_MS || writer_gone(candidate) || segment_expired(info))
+		{
+			munmap(base, info.st_size);
+			return SEGMENT_STALE;
+		}
+		std::this_thread::sleep_for(std::chrono::milliseconds(5));
+		waited += 5;
+	}
+	if(candidate->total_size != (uint64_t)info.st_size)
+	{
+		munmap(base, info.st_size);
+		return SEGMENT_STALE;
+	}
+
+	gen.shared_base = base;
+	gen.shared_size = info.st_size;
+	*header = candidate;
+	return SEGMENT_MAPPED;
+}
+
+static bool segment_matches(const cue_cache_header *header, const cue_generation &gen)
+{
+	if(header->magic != CUE_CACHE_MAGIC || header->version != CUE_CACHE_VERSION ||
+		header->sample_rate != CUE_SAMPLE_RATE || header->channels != CUE_CHANNELS ||
+		header->entry_count != gen.slots.size())
+	{
+		return false;
+	}
+	for(size_t i = 0; i < gen.slots.size(); i++)
+	{
+		const cue_cache_entry &entry = header->entries[i];
+		const cue_slot &slot = gen.slots[i];
+		if(strncmp(entry.name, slot.name.c_str(), CUE_CACHE_NAME_LEN) != 0 ||
+			entry.file_size != slot.file_size || entry.file_mtime != slot.file_mtime ||
+			entry.offset + (uint64_t)entry.frames * CUE_CHANNELS * sizeof(int16_t) > header->total_size)
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+static void unmap_segment(cue_generation &gen)
+{
+	if(gen.shared_base)
+	{
+		munmap(gen.shared_base, gen.shared_size);
+		gen.shared_base = NULL;
+		gen.shared_size = 0;
+	}
+}
+
+//Points every slot at its cue in the mapped segment, dropping any local copy
+static void use_segment(const cue_cache_header *header, cue_generation &gen)
+{
+	for(size_t i = 0; i < gen.slots.size(); i++)
+	{
+		gen.slots[i].pcm.samples = (const int16_t*)((const uint8_t*)gen.shared_base + header->entries[i].offset);
+		gen.slots[i].pcm.frames = header->entries[i].frames;
+		std::vector<int16_t>().swap(gen.slots[i].local);
+	}
+}
+
+//Publishes the locally decoded cues. False if another instance got there first
+//or the segment couldn't be made, the local decode stays in use then.
+static bool publish_segment(const std::string &name, cue_generation &gen)
+{
+	std::vector<cue_slot> &cue_slots = gen.slots;
+	uint64_t total = sizeof(cue_cache_header);
+	for(size_t i = 0; i < cue_slots.size(); i++)
+	{
+		total += cue_slots[i].local.size() * sizeof(int16_t);
+	}
+
+	int fd = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+	if(fd < 0)
+	{
+		if(errno != EEXIST)
+		{
+			blog(LOG_WARNING, "SRBeep: publish_segment: shm_open failed: %s", strerror(errno));
+		}
+		return false;
+	}
+	if(ftruncate(fd, total) != 0)
+	{
+		blog(LOG_WARNING, "SRBeep: publish_segment: ftruncate failed: %s", strerror(errno));
+		close(fd);
+		shm_unlink(name.c_str());
+		return false;
+	}
+	void *base = mmap(NULL, total, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	if(base == MAP_FAILED)
+	{
+		blog(LOG_WARNING, "SRBeep: publish_segment: mmap failed: %s", strerror(errno));
+		close(fd);
+		shm_unlink(name.c_str());
+		return false;
+	}
+	close(fd);
+
+	cue_cache_header *header = (cue_cache_header*)base;
+	header->writer_pid = (uint32_t)getpid();
+	header->magic = CUE_CACHE_MAGIC;
+	header->version = CUE_CACHE_VERSION;
+	header->entry_count = (uint32_t)cue_slots.size();
+	header->sample_rate = CUE_SAMPLE_RATE;
+	header->channels = CUE_CHANNELS;
+	header->total_size = total;
+
+	uint64_t offset = sizeof(cue_cache_header);
+	for(size_t i = 0; i < cue_slots.size(); i++)
+	{
+		cue_cache_entry &entry = header->entries[i];
+		strncpy(entry.name, cue_slots[i].name.c_str(), CUE_CACHE_NAME_LEN - 1);
+		entry.file_size = cue_slots[i].file_size;
+		entry.file_mtime = cue_slots[i].file_mtime;
+		entry.offset = offset;
+		entry.frames = cue_slots[i].pcm.frames;
+
+		size_t bytes = cue_slots[i].local.size() * sizeof(int16_t);
+		if(bytes)
+		{
+			memcpy((uint8_t*)base + offset, &cue_slots[i].local[0], bytes);
+		}
+		cue_slots[i].pcm.samples = (const int16_t*)((uint8_t*)base + offset);
+		std::vector<int16_t>().swap(cue_slots[i].local);
+		offset += bytes;
+	}
+	header->ready.store(1, std::memory_order_release);
+
+	gen.shared_base = base;
+	gen.shared_size = total;
+	return true;
+}
+#endif
+
+cue_generation::~cue_generation()
+{
+#ifndef _WIN32
+	unmap_segment(*this);
+#endif
+}
+
+static bool same_file(const cue_slot &a, const cue_slot &b)
+{
+	return a.name == b.name && a.path == b.path && a.file_size == b.file_size && a.file_mtime == b.file_mtime;
+}
+
+//Decodes every slot, copying cues that haven't changed since the previous generation
+static void decode_locally(cue_generation &gen, const cue_generation *previous)
+{
+	for(size_t i = 0; i < gen.slots.size(); i++)
+	{
+		cue_slot &slot = gen.slots[i];
+		const cue_slot *reuse = NULL;
+		for(size_t j = 0; previous && j < previous->slots.size() && !reuse; j++)
+		{
+			if(same_file(slot, previous->slots[j]) && previous->slots[j].pcm.samples)
+			{
+				reuse = &previous->slots[j];
+			}
+		}
+
+		if(reuse)
+		{
+			slot.local.assign(reuse->pcm.samples, reuse->pcm.samples + (size_t)reuse->pcm.frames * CUE_CHANNELS);
+		}
+		else if(!load_clip(slot.path.c_str(), slot.local))
+		{
+			slot.local.clear();
+		}
+		slot.pcm.samples = slot.local.empty() ? NULL : &slot.local[0];
+		slot.pcm.frames = (uint32_t)(slot.local.size() / CUE_CHANNELS);
+	}
+}
+
+static void count_bytes(const cue_generation &gen)
+{
+	uint64_t bytes = 0;
+	for(size_t i = 0; i < gen.slots.size(); i++)
+	{
+		bytes += (uint64_t)gen.slots[i].pcm.frames * CUE_CHANNELS * sizeof(int16_t);
+	}
+	stats_set_shared_cache_bytes(bytes);
+}
+
+static bool generation_matches(const cue_generation &a, const cue_generation &b)
+{
+	if(a.slots.size() != b.slots.size())
+	{
+		return false;
+	}
+	for(size_t i = 0; i < a.slots.size(); i++)
+	{
+		if(!same_file(a.slots[i], b.slots[i]))
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+void cue_cache_init(const std::vector<cue_file> &files)
+{
+	if(files.size() > CUE_CACHE_MAX_ENTRIES)
+	{
+		blog(LOG_WARNING, "SRBeep: cue_cache_init: Too many cues, only caching %d", CUE_CACHE_MAX_ENTRIES);
+	}
+	size_t count = files.size() < CUE_CACHE_MAX_ENTRIES ? files.size() : CUE_CACHE_MAX_ENTRIES;
+
+	cue_generation_ptr gen = std::make_shared<cue_generation>();
+	gen->slots.resize(count);
+	for(size_t i = 0; i < count; i++)
+	{
+		cue_slot &slot = gen->slots[i];
+		slot.name = files[i].name;
+		slot.path = files[i].path;
+		slot.file_size = 0;
+		slot.file_mtime = 0;
+		cue_file_stat(slot.path, &slot.file_size, &slot.file_mtime);
+		slot.pcm.samples = NULL;
+		slot.pcm.blocks = NULL;
+		slot.pcm.frames = 0;
+	}
+
+	//nothing changed since the last load, keep what we have
+	if(cache && generation_matches(*cache, *gen))
+	{
+		return;
+	}
+	cue_generation_ptr previous = cache;
+
+#ifndef _WIN32
+	std::string name = segment_name(*gen);
+	gen->shared_name = name;
+	//the old set's segment would stay until reboot, instances still mapping it keep their copy
+	if(previous && !previous->shared_name.empty() && previous->shared_name != name)
+	{
+		shm_unlink(previous->shared_name.c_str());
+	}
+	const cue_cache_header *header = NULL;
+	segment_state state = map_segment(name, *gen, &header);
+	if(state == SEGMENT_MAPPED && segment_matches(header, *gen))
+	{
+		use_segment(header, *gen);
+		blog(LOG_INFO, "SRBeep: cue_cache_init: Using shared cue cache");
+		cache = gen;
+		count_bytes(*gen);
+		return;
+	}
+	if(state == SEGMENT_MAPPED)
+	{
+		//a hash collision or another build's layout, instances already mapping it keep their copy
+		unmap_segment(*gen);
+		shm_unlink(name.c_str());
+	}
+	else if(state == SEGMENT_STALE)
+	{
+		blog(LOG_INFO, "SRBeep: cue_cache_init: Removing unfinished shared cue cache");
+		shm_unlink(name.c_str());
+	}
+
+	decode_locally(*gen, previous.get());
+	//unloading, the cues are incomplete and mustn't be shared
+	if(decoder_cancelled())
+	{
+		cache = gen;
+		count_bytes(*gen);
+		return;
+	}
+	if(!publish_segment(name, *gen))
+	{
+		//another instance may have created it while we were decoding, share
+		//theirs if it holds the same cues and keep our own decode otherwise
+		if(map_segment(name, *gen, &header) == SEGMENT_MAPPED && segment_matches(header, *gen))
+		{
+			use_segment(header, *gen);
+		}
+		else
+		{
+			unmap_segment(*gen);
+		}
+	}
+	cache = gen;
+	count_bytes(*gen);
+#else
+	decode_locally(*gen, previous.get());
+	cache = gen;
+	count_bytes(*gen);
+#endif
+}
+
+bool cue_cache_get(const char *name, cue_pcm *cue, std::shared_ptr<void> *owner)
+{
+	if(!cache)
+	{
+		return false;
+	}
+	for(size_t i = 0; i < cache->slots.size(); i++)
+	{
+		if(cache->slots[i].name == name)
+		{
+			*cue = cache->slots[i].pcm;
+			*owner = cache;
+			return cue->samples != NULL && cue->frames > 0;
+		}
+	}
+	return false;
+}
+
+void cue_cache_free(void)
+{
+	cache.reset();
+	stats_set_shared_cache_bytes(0);
+}
@@ -0,0 +1,38 @@
+/***********************************
+A Docile Sloth adocilesloth@gmail.com
+************************************/
+
+#pragma once
+
+#include <memory>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+struct adpcm_block;
+
+//A decoded cue, CUE_CHANNELS interleaved samples per frame. Compressed cues
+//have blocks instead of samples.
+struct cue_pcm
+{
+	const int16_t *samples;
+	const adpcm_block *blocks;
+	uint32_t frames;
+};
+
+struct cue_file
+{
+	std::string name;
+	std::string path;
+};
+
+//Decodes the cues once per host. The first OBS instance fills a shared memory
+//segment, later instances map it read only. Falls back to process local
+//buffers when shared memory is unavailable or out of date. Reloading only
+//decodes files whose name, path, size or mtime changed.
+void cue_cache_init(const std::vector<cue_file> &files);
+//owner keeps the PCM valid across later cue_cache_init/cue_cache_free calls
+bool cue_cache_get(const char *name, cue_pcm *cue, std::shared_ptr<void> *owner);
+void cue_cache_free(void);
+
+bool cue_file_stat(const std::string &path, uint64_t *size, int64_t *mtime);
@@ -0,0 +1,715 @@
+/***********************************
+A Docile Sloth adocilesloth@gmail.com
+************************************/
+
+#include "cue-registry.h"
+#include "adpcm.h"
+#include "decoder.h"
+#include "stats.h"
+#include "synth.h"
+#include <obs-module.h>
+#include <atomic>
+#include <ctype.h>
+#include <list>
+#include <map>
+#include <mutex>
+#include <sstream>
+#include <math.h>
+#include <string.h>
+#include <thread>
+
+#define DEFAULT_SET_BUDGET_MB 64
+
+struct cue_group
+{
+	std::vector<cue_pcm> variants;	//contiguous, indexed directly on the event path
+	cue_select select;
+	float gain;
+	std::atomic<uint32_t> counter;
+};
+
+//What the settings ask for on one event, before anything is decoded
+struct group_config
+{
+	std::vector<std::string> names;
+	cue_select select;
+	float gain;
+};
+
+struct cue_set : public std::enable_shared_from_this<cue_set>
+{
+	std::string key;
+	std::string profile;
+	std::string collection;
+	std::string signature;		//settings and file stats it was built from
+	cue_group groups[CUE_GROUP_COUNT];		//events, then hotkeys, then scenes
+	std::vector<std::shared_ptr<void> > owners;	//keeps every variant's PCM alive
+	size_t bytes;
+	size_t compressed_bytes;		//part of bytes
+	size_t compressed_pcm_bytes;		//what the compressed variants would take as PCM
+};
+typedef std::shared_ptr<cue_set> cue_set_ptr;
+
+//Files decoded outside the shared cache, reused by every set that still holds them
+struct decoded_file
+{
+	std::string path;
+	uint64_t file_size;
+	int64_t file_mtime;
+	std::weak_ptr<std::vector<int16_t> > pcm;
+	std::weak_ptr<std::vector<adpcm_block> > blocks;
+	uint32_t frames;			//of blocks, which are padded to a whole block
+};
+
+struct cue_event_info
+{
+	const char *key;			//settings key under "cues"
+	const char *default_file;
+};
+
+#ifndef SRBEEP_NO_FFMPEG
+static const cue_event_info cue_events[CUE_EVENT_COUNT] =
+{
+	{"stream_start", "stream_start_sound.mp3"},
+	{"stream_stop", "stream_stop_sound.mp3"},
+	{"record_start", "record_start_sound.mp3"},
+	{"record_stop", "record_stop_sound.mp3"},
+	{"buffer_start", "buffer_start_sound.mp3"},
+	{"buffer_stop", "buffer_stop_sound.mp3"},
+	{"pause_start", "pause_start_sound.mp3"},
+	{"pause_stop", "pause_stop_sound.mp3"},
+	{"alarm_dropped_frames", "synth:multi:440+466:400"},
+	{"alarm_congestion", "synth:chirp:900:450:300"},
+	{"alarm_recovered", "synth:chirp:450:900:200"},
+	{"record_milestone", "synth:multi:784+1047:200"},
+	{"stream_milestone", "synth:multi:659+988:200"},
+};
+#else
+//the bundled sounds are mp3, so without FFmpeg the defaults are generated
+static const cue_event_info cue_events[CUE_EVENT_COUNT] =
+{
+	{"stream_start", "synth:chirp:660:1320:180"},
+	{"stream_stop", "synth:chirp:1320:660:180"},
+	{"record_start", "synth:multi:880+1320:150"},
+	{"record_stop", "synth:multi:660+990:150"},
+	{"buffer_start", "synth:tone:1046:120"},
+	{"buffer_stop", "synth:tone:784:120"},
+	{"pause_start", "synth:tone:523:100"},
+	{"pause_stop", "synth:tone:659:100"},
+	{"alarm_dropped_frames", "synth:multi:440+466:400"},
+	{"alarm_congestion", "synth:chirp:900:450:300"},
+	{"alarm_recovered", "synth:chirp:450:900:200"},
+	{"record_milestone", "synth:multi:784+1047:200"},
+	{"stream_milestone", "synth:multi:659+988:200"},
+};
+#endif
+
+static std::atomic<uint64_t> random_state(0x853c49e6748fea9bULL);
+
+static obs_data_t *registry_settings = NULL;
+static size_t set_budget = (size_t)DEFAULT_SET_BUDGET_MB * 1024 * 1024;
+static bool compress_cues = false;
+static std::mutex sets_mutex;
+static std::list<cue_set_ptr> cached_sets;	//most recently used first
+static cue_set_ptr current_set;				//owns current_pick's set, only touched under sets_mutex
+static std::atomic<cue_set*> current_pick(NULL);	//what the event path reads, without locking
+static std::atomic<int> picks_running(0);		//between reading current_pick and taking a reference
+static std::map<std::string, decoded_file> decoded_files;
+static std::string current_profile;
+static std::string current_collection;
+
+static std::string clean_path(std::string audio_path)
+{
+	std::string cleaned_path;
+	//If relative path then the first 2 chars should be ".."
+	if(audio_path.find("..") != std::string::npos)
+	{
+		size_t pos = audio_path.find("..");
+		cleaned_path = audio_path.substr(pos);
+	}
+	//If absolute path, Windows will start with a capital, Linux/Mac will start with "/"
+	else
+	{
+		#ifdef _WIN32
+			while(islower(audio_path[0]) && audio_path.length() > 0)
+			{
+				audio_path = audio_path.substr(1);
+			}
+		#else
+			while(audio_path.substr(0, 1) != "/" && audio_path.length() > 0)
+			{
+				audio_path = audio_path.substr(1);
+			}
+		#endif
+		cleaned_path = audio_path;
+	}
+	return cleaned_path;
+}
+
+static bool is_absolute(const char *file_name)
+{
+	#ifdef _WIN32
+		return isalpha(file_name[0]) && file_name[1] == ':';
+	#else
+		return file_name[0] == '/';
+	#endif
+}
+
+std::string cue_path(const char *file_name)
+{
+	if(is_absolute(file_name) || synth_is_spec(file_name))
+	{
+		return file_name;
+	}
+
+	const char *obs_data_path = obs_get_module_data_path(obs_current_module());
+	std::stringstream audio_path;
+
+	audio_path << obs_data_path;
+	audio_path << "/";
+	audio_path << file_name;
+	return clean_path(audio_path.str());
+}
+
+static cue_select parse_select(const char *select)
+{
+	if(strcmp(select, "round_robin") == 0)
+		return CUE_SELECT_ROUND_ROBIN;
+	if(strcmp(select, "random") == 0)
+		return CUE_SELECT_RANDOM;
+	return CUE_SELECT_FIRST;
+}
+
+static void add_file(std::vector<cue_file> &files, const char *file_name)
+{
+	for(size_t i = 0; i < files.size(); i++)
+	{
+		if(files[i].name == file_name)
+		{
+			return;
+		}
+	}
+	cue_file file;
+	file.name = file_name;
+	file.path = cue_path(file_name);
+	files.push_back(file);
+}
+
+//Reads the variant file names of one group, falling back to the bundled sound if it has one
+static std::vector<std::string> group_files(obs_data_t *group, const char *default_file)
+{
+	std::vector<std::string> names;
+	obs_data_array_t *array = group ? obs_data_get_array(group, "files") : NULL;
+	if(array)
+	{
+		size_t count = obs_data_array_count(array);
+		for(size_t i = 0; i < count; i++)
+		{
+			obs_data_t *item = obs_data_array_item(array, i);
+			const char *file_name = obs_data_get_string(item, "file");
+			if(file_name && *file_name)
+			{
+				names.push_back(file_name);
+			}
+			obs_data_release(item);
+		}
+		obs_data_array_release(array);
+	}
+	if(names.empty() && default_file)
+	{
+		names.push_back(default_file);
+	}
+	return names;
+}
+
+//The "cues" object for a profile or scene collection, if it overrides any
+static obs_data_t *scoped_cues(const char *scope, const std::string &name)
+{
+	if(name.empty())
+	{
+		return NULL;
+	}
+	obs_data_t *scopes = obs_data_get_obj(registry_settings, scope);
+	obs_data_t *entry = scopes ? obs_data_get_obj(scopes, name.c_str()) : NULL;
+	obs_data_t *cues = entry ? obs_data_get_obj(entry, "cues") : NULL;
+	obs_data_release(entry);
+	obs_data_release(scopes);
+	return cues;
+}
+
+//Profiles and collections without overrides share the default set
+static std::string scope_key(const std::string &profile, const std::string &collection)
+{
+	std::string key;
+	obs_data_t *cues = scoped_cues("profiles", profile);
+	if(cues)
+	{
+		key += profile;
+	}
+	obs_data_release(cues);
+	key += '\n';
+	cues = scoped_cues("scene_collections", collection);
+	if(cues)
+	{
+		key += collection;
+	}
+	obs_data_release(cues);
+	return key;
+}
+
+static void read_group(obs_data_t *group, const char *default_file, group_config *config)
+{
+	config->names = group_files(group, default_file);
+	config->select = group ? parse_select(obs_data_get_string(group, "select")) : CUE_SELECT_FIRST;
+	config->gain = group ? (float)pow(10.0, obs_data_get_double(group, "gain_db") / 20.0) : 1.0f;
+	if(config->gain > 1.0f)
+	{
+		config->gain = 1.0f;
+	}
+}
+
+//Hotkeys and scenes are looked up by name in the scoped cues, falling back to
+//their own entry in the settings array
+static void named_groups(obs_data_t *scopes[2], const char *array_key, const char *name_key,
+	int first, int max, group_config configs[CUE_GROUP_COUNT])
+{
+	obs_data_array_t *array = obs_data_get_array(registry_settings, array_key);
+	size_t count = array ? obs_data_array_count(array) : 0;
+	for(int index = 0; index < max; index++)
+	{
+		obs_data_t *entry = (size_t)index < count ? obs_data_array_item(array, index) : NULL;
+		const char *name = entry ? obs_data_get_string(entry, name_key) : "";
+		obs_data_t *group = NULL;
+		for(int scope = 0; scope < 2 && !group && *name; scope++)
+		{
+			group = scopes[scope] ? obs_data_get_obj(scopes[scope], name) : NULL;
+		}
+		read_group(group ? group : entry, NULL, &configs[first + index]);
+		obs_data_release(group);
+		obs_data_release(entry);
+	}
+	obs_data_array_release(array);
+}
+
+//Each event takes the most specific group: scene collection, then profile, then default
+static void scoped_groups(const std::string &profile, const std::string &collection, group_config configs[CUE_GROUP_COUNT])
+{
+	obs_data_t *scopes[3];
+	scopes[0] = scoped_cues("scene_collections", collection);
+	scopes[1] = scoped_cues("profiles", profile);
+	scopes[2] = obs_data_get_obj(registry_settings, "cues");
+
+	for(int event = 0; event < CUE_EVENT_COUNT; event++)
+	{
+		obs_data_t *group = NULL;
+		for(int scope = 0; scope < 3 && !group; scope++)
+		{
+			group = scopes[scope] ? obs_data_get_obj(scopes[scope], cue_events[event].key) : NULL;
+		}
+		read_group(group, cue_events[event].default_file, &configs[event]);
+		obs_data_release(group);
+	}
+
+	named_groups(scopes, "hotkeys", "name", CUE_EVENT_COUNT, CUE_MAX_HOTKEYS, configs);
+	named_groups(scopes, "scenes", "scene", CUE_EVENT_COUNT + CUE_MAX_HOTKEYS, CUE_MAX_SCENES, configs);
+
+	for(int scope = 0; scope < 3; scope++)
+	{
+		obs_data_release(scopes[scope]);
+	}
+}
+
+//Two sets with the same signature play exactly the same audio
+static std::string signature(const group_config configs[CUE_GROUP_COUNT])
+{
+	std::stringstream sig;
+	sig << compress_cues << '\n';
+	for(int event = 0; event < CUE_GROUP_COUNT; event++)
+	{
+		sig << configs[event].select << ' ' << configs[event].gain;
+		for(size_t i = 0; i < configs[event].names.size(); i++)
+		{
+			uint64_t size = 0;
+			int64_t mtime = 0;
+			std::string path = cue_path(configs[event].names[i].c_str());
+			cue_file_stat(path, &size, &mtime);
+			sig << '\n' << path << ' ' << size << ' ' << mtime;
+		}
+		sig << '\n';
+	}
+	return sig.str();
+}
+
+//Finds a cue in the shared cache or the decoded files, decoding it if neither
+//has it. With compress_cues it is kept as ADPCM blocks instead of PCM.
+static bool load_file(const std::string &name, cue_set &set, cue_pcm *cue)
+{
+	std::shared_ptr<void> owner;
+	if(cue_cache_get(name.c_str(), cue, &owner))
+	{
+		set.owners.push_back(owner);
+		return true;
+	}
+
+	decoded_file &file = decoded_files[name];
+	std::string path = cue_path(name.c_str());
+	uint64_t size = 0;
+	int64_t mtime = 0;
+	cue_file_stat(path, &size, &mtime);
+
+	std::shared_ptr<std::vector<int16_t> > pcm = file.pcm.lock();
+	std::shared_ptr<std::vector<adpcm_block> > blocks = file.blocks.lock();
+	bool same = file.path == path && file.file_size == size && file.file_mtime == mtime;
+	if(!same || (compress_cues ? !blocks : !pcm))
+	{
+		pcm = std::make_shared<std::vector<int16_t> >();
+		if(!load_clip(path.c_str(), *pcm))
+		{
+			decoded_files.erase(name);
+			return false;
+		}
+		file.path = path;
+		file.file_size = size;
+		file.file_mtime = mtime;
+		if(compress_cues)
+		{
+			file.frames = (uint32_t)(pcm->size() / CUE_CHANNELS);
+			blocks = std::make_shared<std::vector<adpcm_block> >();
+			adpcm_encode(pcm->empty() ? NULL : &(*pcm)[0], file.frames, *blocks);
+			file.blocks = blocks;
+			//only the compressed copy stays resident
+			pcm.reset();
+		}
+		else
+		{
+			file.pcm = pcm;
+		}
+	}
+
+	if(compress_cues)
+	{
+		cue->samples = NULL;
+		cue->blocks = blocks->empty() ? NULL : &(*blocks)[0];
+		cue->frames = cue->blocks ? file.frames : 0;
+		set.bytes += blocks->size() * sizeof(adpcm_block);
+		set.compressed_bytes += blocks->size() * sizeof(adpcm_block);
+		set.compressed_pcm_bytes += (size_t)cue->frames * CUE_CHANNELS * sizeof(int16_t);
+		set.owners.push_back(blocks);
+		return true;
+	}
+	cue->samples = &(*pcm)[0];
+	cue->blocks = NULL;
+	cue->frames = (uint32_t)(pcm->size() / CUE_CHANNELS);
+	set.bytes += pcm->size() * sizeof(int16_t);
+	set.owners.push_back(pcm);
+	return true;
+}
+
+static cue_set_ptr build_set(const std::string &profile, const std::string &collection)
+{
+	group_config configs[CUE_GROUP_COUNT];
+	scoped_groups(profile, collection, configs);
+
+	cue_set_ptr set = std::make_shared<cue_set>();
+	set->key = scope_key(profile, collection);
+	set->profile = profile;
+	set->collection = collection;
+	set->signature = signature(configs);
+	set->bytes = 0;
+	set->compressed_bytes = 0;
+	set->compressed_pcm_bytes = 0;
+
+	std::map<std::string, cue_pcm> loaded;
+	for(int event = 0; event < CUE_GROUP_COUNT; event++)
+	{
+		cue_group &group = set->groups[event];
+		group.select = configs[event].select;
+		group.gain = configs[event].gain;
+		group.counter = 0;
+		for(size_t i = 0; i < configs[event].names.size(); i++)
+		{
+			const std::string &name = configs[event].names[i];
+			std::map<std::string, cue_pcm>::iterator found = loaded.find(name);
+			cue_pcm cue;
+			if(found != loaded.end())
+			{
+				group.variants.push_back(found->second);
+			}
+			else if(load_file(name, *set, &cue))
+			{
+				loaded[name] = cue;
+				group.variants.push_back(cue);
+			}
+			else if(!decoder_cancelled())
+			{
+				blog(LOG_WARNING, "SRBeep: build_set: Failed to load %s", name.c_str());
+			}
+		}
+	}
+	return set;
+}
+
+//Drops least recently used sets until the budget is met, never the current one
+static void evict_sets(const cue_set_ptr &keep)
+{
+	size_t total = 0;
+	size_t compressed = 0;
+	size_t compressed_pcm = 0;
+	for(std::list<cue_set_ptr>::iterator it = cached_sets.begin(); it != cached_sets.end(); ++it)
+	{
+		total += (*it)->bytes;
+		compressed += (*it)->compressed_bytes;
+		compressed_pcm += (*it)->compressed_pcm_bytes;
+	}
+	std::list<cue_set_ptr>::iterator it = cached_sets.end();
+	while(total > set_budget && it != cached_sets.begin())
+	{
+		--it;
+		if(*it == keep)
+		{
+			continue;
+		}
+		total -= (*it)->bytes;
+		compressed -= (*it)->compressed_bytes;
+		compressed_pcm -= (*it)->compressed_pcm_bytes;
+		it = cached_sets.erase(it);
+	}
+	stats_set_cue_set_bytes(total);
+	stats_set_compressed_bytes(compressed, compressed_pcm);
+}
+
+void cue_registry_load(obs_data_t *settings)
+{
+	obs_data_addref(settings);
+	obs_data_release(registry_settings);
+	registry_settings = settings;
+
+	long long budget_mb = obs_data_get_int(settings, "cue_set_budget_mb");
+	set_budget = (size_t)(budget_mb > 0 ? budget_mb : DEFAULT_SET_BUDGET_MB) * 1024 * 1024;
+	compress_cues = obs_data_get_bool(settings, "compress_cues");
+
+	//the default set goes in the host wide cache, scoped sets are decoded per
+	//process. Unchanged files are not decoded again.
+	group_config configs[CUE_GROUP_COUNT];
+	std::vector<cue_file> files;
+	scoped_groups("", "", configs);
+	for(int event = 0; event < CUE_GROUP_COUNT; event++)
+	{
+		for(size_t i = 0; i < configs[event].names.size(); i++)
+		{
+			add_file(files, configs[event].names[i].c_str());
+		}
+	}
+	//the shared cache holds PCM, compressed cues are all decoded per process
+	if(compress_cues)
+	{
+		cue_cache_free();
+	}
+	else
+	{
+		cue_cache_init(files);
+	}
+
+	//keep sets whose settings and files are unchanged, rebuild the others. The
+	//old sets stay alive until the rebuild is done so their decoded files are reused.
+	std::list<cue_set_ptr> old_sets;
+	{
+		std::lock_guard<std::mutex> lock(sets_mutex);
+		old_sets = cached_sets;
+	}
+	std::list<cue_set_ptr> new_sets;
+	for(std::list<cue_set_ptr>::iterator it = old_sets.begin(); it != old_sets.end(); ++it)
+	{
+		std::string key = scope_key((*it)->profile, (*it)->collection);
+		bool duplicate = false;
+		for(std::list<cue_set_ptr>::iterator added = new_sets.begin(); added != new_sets.end(); ++added)
+		{
+			duplicate = duplicate || (*added)->key == key;
+		}
+		if(duplicate)
+		{
+			continue;
+		}
+
+		scoped_groups((*it)->profile, (*it)->collection, configs);
+		if(key == (*it)->key && signature(configs) == (*it)->signature)
+		{
+			new_sets.push_back(*it);
+		}
+		else
+		{
+			new_sets.push_back(build_set((*it)->profile, (*it)->collection));
+		}
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(sets_mutex);
+		cached_sets.swap(new_sets);
+	}
+	old_sets.clear();
+	new_sets.clear();
+	cue_registry_activate(current_profile, current_collection);
+}
+
+//Makes the set current under sets_mutex. The set it replaces is only let go
+//once every pick that might have read it holds its own reference.
+static void publish_set(const cue_set_ptr &set)
+{
+	cue_set_ptr previous = current_set;
+	current_set = set;
+	current_pick.store(set.get());
+	while(picks_running.load() != 0)
+	{
+		std::this_thread::yield();
+	}
+}
+
+//The current set without taking a lock, the reference comes from the set itself
+static cue_set_ptr acquire_set(void)
+{
+	picks_running.fetch_add(1);
+	cue_set *set = current_pick.load();
+	cue_set_ptr owned = set ? set->shared_from_this() : cue_set_ptr();
+	picks_running.fetch_sub(1, std::memory_order_release);
+	return owned;
+}
+
+void cue_registry_activate(const std::string &profile, const std::string &collection)
+{
+	if(!registry_settings)
+	{
+		return;
+	}
+	current_profile = profile;
+	current_collection = collection;
+
+	std::string key = scope_key(profile, collection);
+	{
+		std::lock_guard<std::mutex> lock(sets_mutex);
+		for(std::list<cue_set_ptr>::iterator it = cached_sets.begin(); it != cached_sets.end(); ++it)
+		{
+			if((*it)->key == key)
+			{
+				cached_sets.splice(cached_sets.begin(), cached_sets, it);
+				publish_set(*it);
+				evict_sets(*it);
+				return;
+			}
+		}
+	}
+
+	cue_set_ptr set = build_set(profile, collection);
+
+	std::lock_guard<std::mutex> lock(sets_mutex);
+	cached_sets.push_front(set);
+	publish_set(set);
+	evict_sets(set);
+}
+
+static bool pick_group(int slot, cue_ref *cue)
+{
+	cue_set_ptr set = acquire_set();
+	if(!set)
+	{
+		return false;
+	}
+	cue_group &group = set->groups[slot];
+	uint32_t count = (uint32_t)group.variants.size();
+	if(count == 0)
+	{
+		return false;
+	}
+
+	uint32_t index = 0;
+	if(group.select == CUE_SELECT_ROUND_ROBIN)
+	{
+		index = group.counter.fetch_add(1, std::memory_order_relaxed) % count;
+	}
+	else if(group.select == CUE_SELECT_RANDOM)
+	{
+		//splitmix64, one atomic step per pick
+		uint64_t z = random_state.fetch_add(0x9e3779b97f4a7c15ULL, std::memory_order_relaxed) + 0x9e3779b97f4a7c15ULL;
+		z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+		z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+		z ^= z >> 31;
+		index = (uint32_t)(z % count);
+	}
+	cue->pcm = group.variants[index];
+	cue->gain = group.gain;
+	cue->set = set;
+	return true;
+}
+
+bool cue_registry_pick(cue_event event, cue_ref *cue)
+{
+	return pick_group(event, cue);
+}
+
+bool cue_registry_pick_hotkey(int hotkey, cue_ref *cue)
+{
+	if(hotkey < 0 || hotkey >= CUE_MAX_HOTKEYS)
+	{
+		return false;
+	}
+	return pick_group(CUE_EVENT_COUNT + hotkey, cue);
+}
+
+bool cue_registry_pick_scene(int scene, cue_ref *cue)
+{
+	if(scene < 0 || scene >= CUE_MAX_SCENES)
+	{
+		return false;
+	}
+	return pick_group(CUE_EVENT_COUNT + CUE_MAX_HOTKEYS + scene, cue);
+}
+
+void cue_registry_free(void)
+{
+	{
+		std::lock_guard<std::mutex> lock(sets_mutex);
+		cached_sets.clear();
+		publish_set(cue_set_ptr());
+	}
+	decoded_files.clear();
+	cue_cache_free();
+	obs_data_release(registry_settings);
+	registry_settings = NULL;
+	stats_set_cue_set_bytes(0);
+	stats_set_compressed_bytes(0, 0);
+}
+
+void cue_registry_current(std::vector<cue_ref> &cues)
+{
+	cues.clear();
+	cue_set_ptr set = acquire_set();
+	if(!set)
+	{
+		return;
+	}
+	for(int event = 0; event < CUE_GROUP_COUNT; event++)
+	{
+		const cue_group &group = set->groups[event];
+		for(size_t i = 0; i < group.variants.size(); i++)
+		{
+			bool seen = false;
+			for(size_t j = 0; j < cues.size() && !seen; j++)
+			{
+				seen = cues[j].pcm.samples == group.variants[i].samples && cues[j].pcm.blocks == group.variants[i].blocks;
+			}
+			if(seen)
+			{
+				continue;
+			}
+			cue_ref cue;
+			cue.pcm = group.variants[i];
+			cue.gain = group.gain;
+			cue.set = set;
+			cues.push_back(cue);
+		}
+	}
+}
+
+const char *cue_event_key(cue_event event)
+{
+	return cue_events[event].key;
+}
@@ -0,0 +1,72 @@
+/***********************************
+A Docile Sloth adocilesloth@gmail.com
+************************************/
+
+#pragma once
+
+#include <obs.h>
+#include <memory>
+#include <vector>
+#include "cue-cache.h"
+
+enum cue_event
+{
+	CUE_STREAM_START,
+	CUE_STREAM_STOP,
+	CUE_RECORD_START,
+	CUE_RECORD_STOP,
+	CUE_BUFFER_START,
+	CUE_BUFFER_STOP,
+	CUE_PAUSE_START,
+	CUE_PAUSE_STOP,
+	CUE_ALARM_DROPPED,		//from the health monitor
+	CUE_ALARM_CONGESTION,
+	CUE_ALARM_RECOVERED,
+	CUE_RECORD_MILESTONE,		//from the milestone timers
+	CUE_STREAM_MILESTONE,
+	CUE_EVENT_COUNT
+};
+
+//Cues fired by hotkey, the "hotkeys" settings array in order
+#define CUE_MAX_HOTKEYS 16
+//Cues played on switching to a scene, the "scenes" settings array in order
+#define CUE_MAX_SCENES 32
+#define CUE_GROUP_COUNT (CUE_EVENT_COUNT + CUE_MAX_HOTKEYS + CUE_MAX_SCENES)
+
+enum cue_select
+{
+	CUE_SELECT_FIRST,
+	CUE_SELECT_ROUND_ROBIN,
+	CUE_SELECT_RANDOM
+};
+
+struct cue_set;
+
+//A picked cue, holding the set it came from so the PCM outlives a set swap
+struct cue_ref
+{
+	cue_pcm pcm;
+	float gain;
+	std::shared_ptr<cue_set> set;
+};
+
+//Applies new settings. The default cues go in the shared cache; only files
+//and sets whose settings changed are decoded or rebuilt again. Slow, call it
+//from the worker once OBS is running.
+void cue_registry_load(obs_data_t *settings);
+//Makes the set for this profile and scene collection current, decoding it
+//first if it isn't cached. Slow, call it from the worker.
+void cue_registry_activate(const std::string &profile, const std::string &collection);
+//Picks a variant for the event, no allocation or string handling
+bool cue_registry_pick(cue_event event, cue_ref *cue);
+//Same for the hotkey at this index in "hotkeys"
+bool cue_registry_pick_hotkey(int hotkey, cue_ref *cue);
+//And for the scene at this index in "scenes"
+bool cue_registry_pick_scene(int scene, cue_ref *cue);
+//Every distinct cue in the current set, eg to warm them up
+void cue_registry_current(std::vector<cue_ref> &cues);
+void cue_registry_free(void);
+//Settings key of the event, eg "stream_start"
+const char *cue_event_key(cue_event event);
+
+std::string cue_path(const char *file_name);
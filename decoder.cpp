@@ -0,0 +1,332 @@
+/***********************************
+A Docile Sloth adocilesloth@gmail.com
+************************************/
+
+#include "decoder.h"
+#include "stats.h"
+#include "synth.h"
+#include "trace.h"
+#include "wav-loader.h"
+#include <obs.h>
+#include <util/platform.h>
+#include <atomic>
+#include <ctype.h>
+#include <string.h>
+
+#ifndef SRBEEP_NO_FFMPEG
+extern "C"
+{
+	#include "libavcodec/avcodec.h"
+	#include "libavformat/avformat.h"
+	#include "libswresample/swresample.h"
+};
+#endif
+
+static std::atomic<uint32_t> decode_budget_ms(DECODE_DEFAULT_BUDGET_MS);
+static std::atomic<uint32_t> decode_max_seconds(DECODE_DEFAULT_MAX_SECONDS);
+static std::atomic<bool> decode_cancelled(false);
+
+void decoder_set_limits(long long budget_ms, long long max_seconds)
+{
+	decode_budget_ms = budget_ms > 0 && budget_ms < 3600000 ? (uint32_t)budget_ms : DECODE_DEFAULT_BUDGET_MS;
+	if(max_seconds > DECODE_MAX_SECONDS_CAP)
+		max_seconds = DECODE_MAX_SECONDS_CAP;
+	decode_max_seconds = max_seconds > 0 ? (uint32_t)max_seconds : DECODE_DEFAULT_MAX_SECONDS;
+}
+
+void decoder_cancel(void)
+{
+	decode_cancelled = true;
+}
+
+bool decoder_cancelled(void)
+{
+	return decode_cancelled;
+}
+
+bool decode_within(const decode_limits &limits, size_t samples, const char *source)
+{
+	//unloading, nobody wants the cue now
+	if(limits.cancel && limits.cancel->load(std::memory_order_relaxed))
+	{
+		return false;
+	}
+	if(samples > limits.max_samples)
+	{
+		stats_decode_oversize();
+		blog(LOG_WARNING, "SRBeep: decode_within: %s is longer than %u seconds", source, (unsigned)decode_max_seconds);
+		return false;
+	}
+	if(os_gettime_ns() > limits.deadline_ns)
+	{
+		stats_decode_timeout();
+		blog(LOG_WARNING, "SRBeep: decode_within: %s took longer than %u ms to decode", source, (unsigned)decode_budget_ms);
+		return false;
+	}
+	return true;
+}
+
+static bool has_extension(const char *path, const char *extension)
+{
+	size_t path_len = strlen(path);
+	size_t ext_len = strlen(extension);
+	if(path_len < ext_len)
+	{
+		return false;
+	}
+	for(size_t i = 0; i < ext_len; i++)
+	{
+		if(tolower(path[path_len - ext_len + i]) != extension[i])
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+static bool load_source(const char *source, std::vector<int16_t> &pcm, const decode_limits &limits)
+{
+	if(synth_is_spec(source))
+	{
+		//a long dtmf string must be refused before it is rendered, not after
+		synth_params params;
+		std::vector<char> digits;
+		return synth_parse(source, &params, digits)
+			&& decode_within(limits, synth_frames(params) * CUE_CHANNELS, source)
+			&& synth_render(params, pcm);
+	}
+	if(has_extension(source, ".raw") || has_extension(source, ".pcm"))
+	{
+		return raw_load(source, pcm, limits);
+	}
+	//the built in reader is cheaper than spinning up FFmpeg for wav
+	if(wav_probe(source))
+	{
+		return wav_load(source, pcm, limits);
+	}
+	return decode_clip(source, pcm, limits);
+}
+
+bool load_clip(const char *source, std::vector<int16_t> &pcm)
+{
+	if(decode_cancelled)
+	{
+		std::vector<int16_t>().swap(pcm);
+		return false;
+	}
+	trace_scope scope("decode");
+	uint64_t start = os_gettime_ns();
+	decode_limits limits;
+	limits.deadline_ns = start + (uint64_t)decode_budget_ms * 1000000;
+	limits.max_samples = (size_t)decode_max_seconds * CUE_SAMPLE_RATE * CUE_CHANNELS;
+	limits.cancel = &decode_cancelled;
+	bool ok = load_source(source, pcm, limits);
+	if(!ok)
+	{
+		//a decode stopped part way must not leave a half cue behind
+		std::vector<int16_t>().swap(pcm);
+	}
+	stats_decode(os_gettime_ns() - start, ok);
+	return ok;
+}
+
+#ifdef SRBEEP_NO_FFMPEG
+bool decode_clip(const char *filepath, std::vector<int16_t> &pcm, const decode_limits &limits)
+{
+	pcm.clear();
+	blog(LOG_WARNING, "SRBeep: decode_clip: Built without FFmpeg, can't load %s", filepath);
+	return false;
+}
+#else
+static bool convert_frame(SwrContext *convert_ctx, AVFrame *frame, std::vector<int16_t> &pcm)
+{
+	//frame == NULL drains whatever swr is still holding
+	int in_samples = frame ? frame->nb_samples : 0;
+	int out_samples = swr_get_out_samples(convert_ctx, in_samples);
+	if(out_samples <= 0)
+	{
+		return true;
+	}
+	size_t old_size = pcm.size();
+	pcm.resize(old_size + (size_t)out_samples * CUE_CHANNELS);
+	uint8_t *out = (uint8_t*)&pcm[old_size];
+	int converted = swr_convert(convert_ctx, &out, out_samples, frame ? (const uint8_t**)frame->data : NULL, in_samples);
+	if(converted < 0)
+	{
+		pcm.resize(old_size);
+		return false;
+	}
+	pcm.resize(old_size + (size_t)converted * CUE_CHANNELS);
+	return true;
+}
+
+//Lets FFmpeg give up on blocking reads once the budget is spent or at unload
+static int interrupt_decode(void *opaque)
+{
+	const decode_limits *limits = (const decode_limits*)opaque;
+	if(limits->cancel && limits->cancel->load(std::memory_order_relaxed))
+	{
+		return 1;
+	}
+	return os_gettime_ns() > limits->deadline_ns ? 1 : 0;
+}
+
+static bool receive_frames(AVCodecContext *cdx, AVFrame *frame, SwrContext *convert_ctx, std::vector<int16_t> &pcm)
+{
+	while(true)
+	{
+		int ret = avcodec_receive_frame(cdx, frame);
+		if(ret == AVERROR(EAGAIN) || ret == AVERROR_EOF)
+		{
+			return true;
+		}
+		if(ret < 0)
+		{
+			return false;
+		}
+		bool converted = convert_frame(convert_ctx, frame, pcm);
+		av_frame_unref(frame);
+		if(!converted)
+		{
+			return false;
+		}
+	}
+}
+
+bool decode_clip(const char *filepath, std::vector<int16_t> &pcm, const decode_limits &limits)
+{
+	/*****************************************************************
+	Adapted from simplest_ffmpeg_audio_player by leixiaohua1020
+	Download at https://sourceforge.net/projects/simplestffmpegplayer/
+	*****************************************************************/
+	AVFormatContext *stream_start = NULL;
+	AVCodecContext *cdx = NULL;
+	AVPacket *packet = NULL;
+	AVFrame *frame = NULL;
+	SwrContext *au_convert_ctx = NULL;
+	AVCodec *codec = NULL;
+	int audioStreamIndex = -1;
+	bool ok = false;
+
+	pcm.clear();
+
+	stream_start = avformat_alloc_context();
+	if(!stream_start)
+	{
+		return false;
+	}
+	stream_start->interrupt_callback.callback = interrupt_decode;
+	stream_start->interrupt_callback.opaque = (void*)&limits;
+	//frees stream_start on failure
+	if(avformat_open_input(&stream_start, filepath, NULL, NULL) != 0)
+	{
+		//a timeout or cancel is logged as that instead
+		if(decode_within(limits, 0, filepath))
+		{
+			blog(LOG_WARNING, "SRBeep: decode_clip: Failed to open file %s", filepath);
+		}
+		return false;
+	}
+
+	if(avformat_find_stream_info(stream_start, NULL) < 0)
+	{
+		blog(LOG_WARNING, "SRBeep: decode_clip: Failed to find stream info in %s", filepath);
+		goto cleanup;
+	}
+
+	//reject a file that says it is too long before decoding any of it
+	if(stream_start->duration != AV_NOPTS_VALUE && stream_start->duration > 0 &&
+		!decode_within(limits, (size_t)(stream_start->duration / AV_TIME_BASE) * CUE_SAMPLE_RATE * CUE_CHANNELS, filepath))
+	{
+		goto cleanup;
+	}
+
+	audioStreamIndex = av_find_best_stream(stream_start, AVMEDIA_TYPE_AUDIO, -1, -1, &codec, 0);
+	if(audioStreamIndex < 0 || !codec)
+	{
+		blog(LOG_WARNING, "SRBeep: decode_clip: Failed to find audio stream in %s", filepath);
+		goto cleanup;
+	}
+
+	//get codec
+	cdx = avcodec_alloc_context3(codec);
+	if(!cdx || avcodec_parameters_to_context(cdx, stream_start->streams[audioStreamIndex]->codecpar) < 0)
+	{
+		blog(LOG_WARNING, "SRBeep: decode_clip: Codec not supported");
+		goto cleanup;
+	}
+	if(avcodec_open2(cdx, codec, NULL) < 0)
+	{
+		blog(LOG_WARNING, "SRBeep: decode_clip: Failed to open codec");
+		goto cleanup;
+	}
+
+	//FIX:Some Codec's Context Information is missing
+	au_convert_ctx = swr_alloc_set_opts(NULL,
+		AV_CH_LAYOUT_STEREO, AV_SAMPLE_FMT_S16, CUE_SAMPLE_RATE,
+		cdx->channel_layout ? cdx->channel_layout : av_get_default_channel_layout(cdx->channels),
+		cdx->sample_fmt, cdx->sample_rate, 0, NULL);
+	if(!au_convert_ctx || swr_init(au_convert_ctx) < 0)
+	{
+		blog(LOG_WARNING, "SRBeep: decode_clip: Failed to set up resampler");
+		goto cleanup;
+	}
+
+	packet = av_packet_alloc();
+	frame = av_frame_alloc();
+	if(!packet || !frame)
+	{
+		goto cleanup;
+	}
+
+	while(av_read_frame(stream_start, packet) >= 0)
+	{
+		if(packet->stream_index == audioStreamIndex)
+		{
+			int ret = avcodec_send_packet(cdx, packet);
+			if(ret < 0 && ret != AVERROR(EAGAIN))
+			{
+				av_packet_unref(packet);
+				blog(LOG_WARNING, "SRBeep: decode_clip: Decoding audio frame error");
+				goto cleanup;
+			}
+			if(!receive_frames(cdx, frame, au_convert_ctx, pcm))
+			{
+				av_packet_unref(packet);
+				blog(LOG_WARNING, "SRBeep: decode_clip: Decoding audio frame error");
+				goto cleanup;
+			}
+		}
+		av_packet_unref(packet);
+		if(!decode_within(limits, pcm.size(), filepath))
+		{
+			goto cleanup;
+		}
+	}
+	//an interrupted read ends the loop like the end of the file does
+	if(!decode_within(limits, pcm.size(), filepath))
+	{
+		goto cleanup;
+	}
+	//flush the decoder and the resampler
+	avcodec_send_packet(cdx, NULL);
+	if(!receive_frames(cdx, frame, au_convert_ctx, pcm) || !convert_frame(au_convert_ctx, NULL, pcm))
+	{
+		blog(LOG_WARNING, "SRBeep: decode_clip: Decoding audio frame error");
+		goto cleanup;
+	}
+	ok = !pcm.empty();
+
+cleanup:
+	av_packet_free(&packet);
+	av_frame_free(&frame);
+	swr_free(&au_convert_ctx);
+	avcodec_free_context(&cdx);
+	avformat_close_input(&stream_start);
+	if(!ok)
+	{
+		pcm.clear();
+	}
+	return ok;
+}
+#endif
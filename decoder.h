@@ -0,0 +1,42 @@
+/***********************************
+A Docile Sloth adocilesloth@gmail.com
+************************************/
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <atomic>
+#include <vector>
+
+//Every cue is held as interleaved signed 16bit stereo at this rate
+#define CUE_SAMPLE_RATE 48000
+#define CUE_CHANNELS 2
+
+#define DECODE_DEFAULT_BUDGET_MS 2000
+#define DECODE_DEFAULT_MAX_SECONDS 30
+#define DECODE_MAX_SECONDS_CAP 600
+
+//Bounds one decode, so a pathological file can't stall the worker or grow
+//without end in a long running session
+struct decode_limits
+{
+	uint64_t deadline_ns;		//os_gettime_ns
+	size_t max_samples;
+	const std::atomic<bool> *cancel;	//set at unload, checked with the deadline
+};
+
+//Applies to every later decode, 0 or less for the defaults
+void decoder_set_limits(long long budget_ms, long long max_seconds);
+//Makes every running and later decode give up at its next check, for unload
+void decoder_cancel(void);
+bool decoder_cancelled(void);
+//False once the decode is over its deadline, samples would go past the size
+//limit or it was cancelled. Logs and counts why, so callers only need to stop.
+bool decode_within(const decode_limits &limits, size_t samples, const char *source);
+
+//Decodes a whole file into cue format PCM, returns false on failure
+bool decode_clip(const char *filepath, std::vector<int16_t> &pcm, const decode_limits &limits);
+//Like decode_clip, but "synth:" sources are generated without touching the
+//decoder. Sets up the limits for the load.
+bool load_clip(const char *source, std::vector<int16_t> &pcm);
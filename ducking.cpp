@@ -0,0 +1,168 @@
+/***********************************
+A Docile Sloth adocilesloth@gmail.com
+************************************/
+
+#include "ducking.h"
+#include <atomic>
+#include <cmath>
+#include <mutex>
+#include <string>
+#include <vector>
+
+struct duck_target
+{
+	obs_source_t *source;
+	float original_volume;
+};
+
+static std::mutex duck_settings_mutex;	//settings can be reloaded while a cue plays
+static bool duck_enabled = false;
+static std::vector<std::string> duck_source_names;
+static float duck_gain = 0.25f;		//linear gain applied while ducked
+static float duck_attack_ms = 30.0f;
+static float duck_release_ms = 250.0f;
+
+static std::mutex duck_targets_mutex;	//engage/stop against the audio callback
+static std::vector<duck_target> duck_targets;
+static float envelope = 1.0f;
+static float applied_gain = 1.0f;
+static float attack_frames = 1.0f;	//time constants in frames
+static float release_frames = 1.0f;
+static uint32_t pending_frames = 0;	//frames the callback couldn't process while locked out
+
+#define DUCK_APPLY_STEP 0.005f		//don't spam obs_source_set_volume for tiny changes
+#define DUCK_SNAP 0.001f
+
+void ducking_load_settings(obs_data_t *settings)
+{
+	obs_data_set_default_bool(settings, "duck_enabled", false);
+	obs_data_set_default_double(settings, "duck_level_db", -12.0);
+	obs_data_set_default_double(settings, "duck_attack_ms", 30.0);
+	obs_data_set_default_double(settings, "duck_release_ms", 250.0);
+
+	std::lock_guard<std::mutex> lock(duck_settings_mutex);
+	duck_enabled = obs_data_get_bool(settings, "duck_enabled");
+	duck_gain = (float)pow(10.0, obs_data_get_double(settings, "duck_level_db") / 20.0);
+	duck_attack_ms = (float)obs_data_get_double(settings, "duck_attack_ms");
+	duck_release_ms = (float)obs_data_get_double(settings, "duck_release_ms");
+
+	duck_source_names.clear();
+	obs_data_array_t *sources = obs_data_get_array(settings, "duck_sources");
+	if(sources)
+	{
+		size_t count = obs_data_array_count(sources);
+		for(size_t i = 0; i < count; i++)
+		{
+			obs_data_t *item = obs_data_array_item(sources, i);
+			const char *name = obs_data_get_string(item, "name");
+			if(name && *name)
+			{
+				duck_source_names.push_back(name);
+			}
+			obs_data_release(item);
+		}
+		obs_data_array_release(sources);
+	}
+}
+
+//Expects duck_targets_mutex to be held
+static void release_targets(void)
+{
+	for(size_t i = 0; i < duck_targets.size(); i++)
+	{
+		//once fully released the source is already back at its volume,
+		//which the user may have changed since
+		if(applied_gain < 1.0f)
+		{
+			obs_source_set_volume(duck_targets[i].source, duck_targets[i].original_volume);
+		}
+		obs_source_release(duck_targets[i].source);
+	}
+	duck_targets.clear();
+	envelope = 1.0f;
+	applied_gain = 1.0f;
+	pending_frames = 0;
+}
+
+void ducking_engage(int sample_rate)
+{
+	std::lock_guard<std::mutex> targets_lock(duck_targets_mutex);
+	if(!duck_targets.empty() && applied_gain < 1.0f)
+	{
+		return;
+	}
+	release_targets();
+
+	std::lock_guard<std::mutex> lock(duck_settings_mutex);
+	if(!duck_enabled)
+	{
+		return;
+	}
+
+	attack_frames = duck_attack_ms * sample_rate / 1000.0f;
+	release_frames = duck_release_ms * sample_rate / 1000.0f;
+	if(attack_frames < 1.0f)
+		attack_frames = 1.0f;
+	if(release_frames < 1.0f)
+		release_frames = 1.0f;
+
+	for(size_t i = 0; i < duck_source_names.size(); i++)
+	{
+		obs_source_t *source = obs_get_source_by_name(duck_source_names[i].c_str());
+		if(!source)
+		{
+			blog(LOG_WARNING, "SRBeep: ducking_engage: No source named %s", duck_source_names[i].c_str());
+			continue;
+		}
+		duck_target target;
+		target.source = source;
+		target.original_volume = obs_source_get_volume(source);
+		duck_targets.push_back(target);
+	}
+}
+
+void ducking_process(uint32_t frames, bool cue_active)
+{
+	//never block the audio callback, catch up on the next period instead
+	std::unique_lock<std::mutex> lock(duck_targets_mutex, std::try_to_lock);
+	if(!lock.owns_lock())
+	{
+		pending_frames += frames;
+		return;
+	}
+	frames += pending_frames;
+	pending_frames = 0;
+	if(duck_targets.empty())
+	{
+		return;
+	}
+
+	//one pole envelope, advanced by the frames the device actually consumed
+	float target = cue_active ? duck_gain : 1.0f;
+	float time_constant = target < envelope ? attack_frames : release_frames;
+	envelope = target + (envelope - target) * expf(-(float)frames / time_constant);
+	if(fabsf(envelope - target) < DUCK_SNAP)
+	{
+		envelope = target;
+	}
+
+	if(envelope == applied_gain)
+	{
+		return;
+	}
+	if(fabsf(envelope - applied_gain) < DUCK_APPLY_STEP && envelope != target)
+	{
+		return;
+	}
+	applied_gain = envelope;
+	for(size_t i = 0; i < duck_targets.size(); i++)
+	{
+		obs_source_set_volume(duck_targets[i].source, duck_targets[i].original_volume * envelope);
+	}
+}
+
+void ducking_stop(void)
+{
+	std::lock_guard<std::mutex> lock(duck_targets_mutex);
+	release_targets();
+}
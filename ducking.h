@@ -0,0 +1,22 @@
+/***********************************
+A Docile Sloth adocilesloth@gmail.com
+************************************/
+
+#pragma once
+
+#include <obs.h>
+#include <stdint.h>
+
+//Ducking lowers the volume of selected OBS sources while a cue is playing.
+//The envelope is advanced by the number of frames the audio device consumes,
+//so it follows the device's sample clock rather than wall-clock sleeps.
+
+void ducking_load_settings(obs_data_t *settings);
+
+//Called when a cue is queued, resolves the configured sources unless they
+//are still ducked from the previous cue
+void ducking_engage(int sample_rate);
+//Called from the audio callback with the frames just rendered
+void ducking_process(uint32_t frames, bool cue_active);
+//Restores and releases the sources
+void ducking_stop(void);
@@ -0,0 +1,107 @@
+/***********************************
+A Docile Sloth adocilesloth@gmail.com
+************************************/
+
+//libFuzzer target for the decode engine. Every input is written to a scratch
+//file and run through the wav and raw loaders, FFmpeg and load_clip, and as a
+//synth spec. A loader may refuse anything, but must not crash, leak, run over
+//its limits or hand back a cue that isn't whole frames.
+//	make fuzz
+//	mkdir -p fuzz/corpus && ./fuzz/fuzz-decode fuzz/corpus resource
+
+#include "../decoder.h"
+#include "../wav-loader.h"
+#include <obs-module.h>
+#include <util/platform.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+#include <unistd.h>
+
+OBS_DECLARE_MODULE()
+
+//Small limits keep each run quick, the checks are the same at any size
+#define FUZZ_BUDGET_MS 250
+#define FUZZ_MAX_SECONDS 5
+//the resampler flush can add a filter's worth of frames after the last check
+#define FUZZ_SLACK_SAMPLES (4096 * CUE_CHANNELS)
+
+static std::string scratch_path;
+
+static void check(bool ok, const std::vector<int16_t> &pcm, uint64_t start_ns, const char *loader)
+{
+	uint64_t took_ms = (os_gettime_ns() - start_ns) / 1000000;
+	size_t max_samples = (size_t)FUZZ_MAX_SECONDS * CUE_SAMPLE_RATE * CUE_CHANNELS + FUZZ_SLACK_SAMPLES;
+	//give up means give up, not carry on for another budget
+	if(took_ms > FUZZ_BUDGET_MS * 2)
+	{
+		fprintf(stderr, "fuzz-decode: %s took %llu ms\n", loader, (unsigned long long)took_ms);
+		abort();
+	}
+	if(ok && (pcm.size() % CUE_CHANNELS != 0 || pcm.size() > max_samples))
+	{
+		fprintf(stderr, "fuzz-decode: %s returned %zu samples\n", loader, pcm.size());
+		abort();
+	}
+}
+
+static decode_limits fuzz_limits(void)
+{
+	decode_limits limits;
+	limits.deadline_ns = os_gettime_ns() + (uint64_t)FUZZ_BUDGET_MS * 1000000;
+	limits.max_samples = (size_t)FUZZ_MAX_SECONDS * CUE_SAMPLE_RATE * CUE_CHANNELS;
+	limits.cancel = NULL;
+	return limits;
+}
+
+extern "C" int LLVMFuzzerInitialize(int *argc, char ***argv)
+{
+	decoder_set_limits(FUZZ_BUDGET_MS, FUZZ_MAX_SECONDS);
+	const char *dir = getenv("TMPDIR");
+	char name[64];
+	snprintf(name, sizeof(name), "/srbeep-fuzz-%d", (int)getpid());
+	scratch_path = std::string(dir && *dir ? dir : "/tmp") + name;
+	return 0;
+}
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size)
+{
+	FILE *file = fopen(scratch_path.c_str(), "wb");
+	if(!file)
+	{
+		return 0;
+	}
+	fwrite(data, 1, size, file);
+	fclose(file);
+
+	std::vector<int16_t> pcm;
+	uint64_t start = os_gettime_ns();
+	bool ok = wav_load(scratch_path.c_str(), pcm, fuzz_limits());
+	check(ok, pcm, start, "wav_load");
+
+	start = os_gettime_ns();
+	ok = raw_load(scratch_path.c_str(), pcm, fuzz_limits());
+	check(ok, pcm, start, "raw_load");
+
+	start = os_gettime_ns();
+	ok = decode_clip(scratch_path.c_str(), pcm, fuzz_limits());
+	check(ok, pcm, start, "decode_clip");
+
+	//load_clip picks the loader itself and must never leave half a cue behind
+	start = os_gettime_ns();
+	ok = load_clip(scratch_path.c_str(), pcm);
+	check(ok, pcm, start, "load_clip");
+	if(!ok && !pcm.empty())
+	{
+		fprintf(stderr, "fuzz-decode: load_clip failed but kept %zu samples\n", pcm.size());
+		abort();
+	}
+
+	std::string spec = "synth:" + std::string((const char*)data, size);
+	start = os_gettime_ns();
+	ok = load_clip(spec.c_str(), pcm);
+	check(ok, pcm, start, "synth");
+
+	unlink(scratch_path.c_str());
+	return 0;
+}
@@ -0,0 +1,201 @@
+/***********************************
+A Docile Sloth adocilesloth@gmail.com
+************************************/
+
+#include "health.h"
+#include "stats.h"
+#include "timer-wheel.h"
+#include <util/platform.h>
+#include <mutex>
+
+struct health_settings
+{
+	bool enabled;
+	uint32_t poll_ms;
+	int sustain_polls;			//polls past a threshold before it raises or clears
+	double drop_raise_percent;
+	double drop_clear_percent;
+	double congestion_raise;
+	double congestion_clear;
+	uint64_t cooldown_ns;
+	bool recovered_cue;
+};
+
+struct health_alarm
+{
+	bool raised;
+	bool fired;					//this raise was heard, so its recovery is too
+	int polls;					//consecutive polls towards the next change
+	uint64_t last_fired_ns;
+};
+
+static std::mutex health_mutex;
+static wheel_timer health_timer;
+static bool health_timer_ready = false;
+static health_settings settings_copy;
+static obs_output_t *health_output = NULL;
+static uint64_t health_generation = 0;		//bumped by every start, resets the baseline
+static health_alarm_func alarm_func = NULL;
+
+//Only touched by the timer callback
+static health_alarm dropped_alarm = {false, false, 0, 0};
+static health_alarm congestion_alarm = {false, false, 0, 0};
+static uint64_t seen_generation = 0;
+static bool have_baseline = false;
+static int last_dropped = 0;
+static int last_total = 0;
+
+static void health_poll(void *data);
+
+//Expects health_mutex to be held
+static void schedule_poll(void)
+{
+	if(!health_timer_ready)
+	{
+		wheel_timer_init(&health_timer, health_poll, NULL);
+		health_timer_ready = true;
+	}
+	if(health_output && settings_copy.enabled)
+	{
+		wheel_timer_schedule(&health_timer, settings_copy.poll_ms);
+	}
+	else
+	{
+		wheel_timer_cancel(&health_timer);
+	}
+}
+
+void health_load_settings(obs_data_t *settings)
+{
+	obs_data_set_default_bool(settings, "health_monitor", false);
+	obs_data_set_default_int(settings, "health_poll_ms", 1000);
+	obs_data_set_default_int(settings, "health_sustain_polls", 2);
+	obs_data_set_default_double(settings, "health_drop_percent", 1.0);
+	obs_data_set_default_double(settings, "health_drop_clear_percent", 0.2);
+	obs_data_set_default_double(settings, "health_congestion", 0.5);
+	obs_data_set_default_double(settings, "health_congestion_clear", 0.2);
+	obs_data_set_default_int(settings, "health_cooldown_s", 60);
+	obs_data_set_default_bool(settings, "health_recovered_cue", true);
+
+	long long poll_ms = obs_data_get_int(settings, "health_poll_ms");
+	long long sustain = obs_data_get_int(settings, "health_sustain_polls");
+	long long cooldown_s = obs_data_get_int(settings, "health_cooldown_s");
+
+	std::lock_guard<std::mutex> lock(health_mutex);
+	settings_copy.enabled = obs_data_get_bool(settings, "health_monitor");
+	//polling is three cheap getters, but never more than 10 times a second
+	settings_copy.poll_ms = (uint32_t)(poll_ms < 100 ? 100 : (poll_ms > 60000 ? 60000 : poll_ms));
+	settings_copy.sustain_polls = (int)(sustain < 1 ? 1 : (sustain > 100 ? 100 : sustain));
+	settings_copy.drop_raise_percent = obs_data_get_double(settings, "health_drop_percent");
+	settings_copy.drop_clear_percent = obs_data_get_double(settings, "health_drop_clear_percent");
+	settings_copy.congestion_raise = obs_data_get_double(settings, "health_congestion");
+	settings_copy.congestion_clear = obs_data_get_double(settings, "health_congestion_clear");
+	settings_copy.cooldown_ns = (uint64_t)(cooldown_s > 0 ? cooldown_s : 0) * 1000000000ULL;
+	settings_copy.recovered_cue = obs_data_get_bool(settings, "health_recovered_cue");
+	schedule_poll();
+}
+
+//Raises after sustain_polls at or above raise, clears after as many at or below clear
+static void update_alarm(health_alarm &alarm, double value, double raise, double clear,
+	cue_event event, const health_settings &settings, health_alarm_func alarm_cb)
+{
+	bool towards = alarm.raised ? value <= clear : value >= raise;
+	alarm.polls = towards ? alarm.polls + 1 : 0;
+	if(alarm.polls < settings.sustain_polls)
+	{
+		return;
+	}
+	alarm.polls = 0;
+	alarm.raised = !alarm.raised;
+
+	uint64_t now = os_gettime_ns();
+	if(alarm.raised)
+	{
+		alarm.fired = !alarm.last_fired_ns || now - alarm.last_fired_ns >= settings.cooldown_ns;
+		stats_health_alarm(alarm.fired);
+		if(alarm.fired)
+		{
+			alarm.last_fired_ns = now;
+			blog(LOG_WARNING, "SRBeep: update_alarm: %s raised at %.3f", cue_event_key(event), value);
+			alarm_cb(event);
+		}
+	}
+	else
+	{
+		blog(LOG_INFO, "SRBeep: update_alarm: %s cleared at %.3f", cue_event_key(event), value);
+		if(alarm.fired && settings.recovered_cue)
+		{
+			alarm_cb(CUE_ALARM_RECOVERED);
+		}
+		alarm.fired = false;
+	}
+}
+
+//Runs on the timer wheel thread, which is the only one touching the alarm state
+static void health_poll(void *data)
+{
+	std::unique_lock<std::mutex> lock(health_mutex);
+	if(!health_output || !settings_copy.enabled)
+	{
+		return;
+	}
+	if(seen_generation != health_generation)
+	{
+		seen_generation = health_generation;
+		have_baseline = false;
+		dropped_alarm.raised = congestion_alarm.raised = false;
+		dropped_alarm.polls = congestion_alarm.polls = 0;
+	}
+	obs_output_t *output = health_output;
+	obs_output_addref(output);
+	health_settings settings = settings_copy;
+	health_alarm_func alarm_cb = alarm_func;
+	wheel_timer_schedule(&health_timer, settings.poll_ms);
+	lock.unlock();
+
+	stats_health_poll();
+	int dropped = obs_output_get_frames_dropped(output);
+	int total = obs_output_get_total_frames(output);
+	float congestion = obs_output_get_congestion(output);
+	obs_output_release(output);
+
+	if(have_baseline)
+	{
+		//the drop rate over this poll, not since the stream started
+		int new_total = total - last_total;
+		int new_dropped = dropped - last_dropped;
+		double drop_percent = new_total > 0 ? 100.0 * new_dropped / new_total : 0.0;
+		update_alarm(dropped_alarm, drop_percent, settings.drop_raise_percent, settings.drop_clear_percent,
+			CUE_ALARM_DROPPED, settings, alarm_cb);
+		update_alarm(congestion_alarm, congestion, settings.congestion_raise, settings.congestion_clear,
+			CUE_ALARM_CONGESTION, settings, alarm_cb);
+	}
+	have_baseline = true;
+	last_dropped = dropped;
+	last_total = total;
+}
+
+void health_start(obs_output_t *output, health_alarm_func alarm)
+{
+	std::lock_guard<std::mutex> lock(health_mutex);
+	obs_output_release(health_output);
+	health_output = output;
+	alarm_func = alarm;
+	health_generation++;
+	schedule_poll();
+}
+
+void health_stop(void)
+{
+	std::lock_guard<std::mutex> lock(health_mutex);
+	obs_output_release(health_output);
+	health_output = NULL;
+	schedule_poll();
+}
+
+void health_shutdown(void)
+{
+	std::lock_guard<std::mutex> lock(health_mutex);
+	obs_output_release(health_output);
+	health_output = NULL;
+}
@@ -0,0 +1,22 @@
+/***********************************
+A Docile Sloth adocilesloth@gmail.com
+************************************/
+
+#pragma once
+
+#include <obs.h>
+#include "cue-registry.h"
+
+//Watches the streaming output for dropped frames and congestion from a timer
+//on the timer wheel and plays an alarm cue when either stays past its
+//threshold. Alarms clear below a lower threshold and don't repeat within the
+//cooldown, so a flapping connection can't flood the operator.
+
+typedef void (*health_alarm_func)(cue_event event);
+
+void health_load_settings(obs_data_t *settings);
+//Takes over the caller's reference to output
+void health_start(obs_output_t *output, health_alarm_func alarm);
+void health_stop(void);
+//Only at module unload, after the timer wheel has stopped
+void health_shutdown(void);
@@ -0,0 +1,192 @@
+/***********************************
+A Docile Sloth adocilesloth@gmail.com
+************************************/
+
+#include "hotkeys.h"
+#include "cue-registry.h"
+#include "stats.h"
+#include <util/platform.h>
+#include <atomic>
+#include <stdint.h>
+#include <string>
+
+#define HOTKEY_DEFAULT_INTERVAL_MS 250
+
+struct hotkey_entry
+{
+	std::string name;
+	std::string description;
+	obs_hotkey_id id;
+	std::atomic<uint64_t> min_interval_ns;
+	std::atomic<uint64_t> last_fired_ns;
+};
+
+static hotkey_entry hotkeys[CUE_MAX_HOTKEYS];
+static std::atomic<int> hotkey_count(0);		//read by the hotkey thread
+
+struct hotkey_config
+{
+	std::string name;
+	std::string description;
+	uint64_t min_interval_ns;
+};
+
+static int read_configs(obs_data_t *settings, hotkey_config configs[CUE_MAX_HOTKEYS])
+{
+	obs_data_array_t *array = obs_data_get_array(settings, "hotkeys");
+	size_t count = array ? obs_data_array_count(array) : 0;
+	if(count > CUE_MAX_HOTKEYS)
+	{
+		blog(LOG_WARNING, "SRBeep: hotkeys_update: Only the first %d hotkeys are used", CUE_MAX_HOTKEYS);
+		count = CUE_MAX_HOTKEYS;
+	}
+	for(size_t i = 0; i < count; i++)
+	{
+		obs_data_t *entry = obs_data_array_item(array, i);
+		configs[i].name = obs_data_get_string(entry, "name");
+		configs[i].description = obs_data_get_string(entry, "description");
+		if(configs[i].description.empty())
+		{
+			configs[i].description = configs[i].name;
+		}
+		long long interval_ms = obs_data_has_user_value(entry, "min_interval_ms") ?
+			obs_data_get_int(entry, "min_interval_ms") : HOTKEY_DEFAULT_INTERVAL_MS;
+		configs[i].min_interval_ns = (uint64_t)(interval_ms > 0 ? interval_ms : 0) * 1000000;
+		obs_data_release(entry);
+	}
+	obs_data_array_release(array);
+	return (int)count;
+}
+
+static bool same_hotkeys(const hotkey_config configs[CUE_MAX_HOTKEYS], int count)
+{
+	if(count != hotkey_count)
+	{
+		return false;
+	}
+	for(int i = 0; i < count; i++)
+	{
+		if(configs[i].name != hotkeys[i].name || configs[i].description != hotkeys[i].description)
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+void hotkeys_update(obs_data_t *settings, obs_hotkey_func func)
+{
+	hotkey_config configs[CUE_MAX_HOTKEYS];
+	int count = read_configs(settings, configs);
+	if(same_hotkeys(configs, count))
+	{
+		for(int i = 0; i < count; i++)
+		{
+			hotkeys[i].min_interval_ns = configs[i].min_interval_ns;
+		}
+		return;
+	}
+
+	//carry the bindings of hotkeys that survive over to their new slot
+	obs_data_t *bindings = obs_data_create();
+	hotkeys_save_bindings(bindings);
+	hotkeys_free();
+
+	for(int i = 0; i < count; i++)
+	{
+		hotkey_entry &hotkey = hotkeys[i];
+		hotkey.name = configs[i].name;
+		hotkey.description = configs[i].description;
+		hotkey.min_interval_ns = configs[i].min_interval_ns;
+		hotkey.last_fired_ns = 0;
+		if(hotkey.name.empty())
+		{
+			blog(LOG_WARNING, "SRBeep: hotkeys_update: Hotkey %d has no name", i);
+			hotkey.id = OBS_INVALID_HOTKEY_ID;
+			continue;
+		}
+		std::string id_name = "SRBeep.hotkey." + hotkey.name;
+		std::string description = "SRBeep: " + hotkey.description;
+		hotkey.id = obs_hotkey_register_frontend(id_name.c_str(), description.c_str(), func, (void*)(intptr_t)i);
+	}
+	hotkey_count = count;
+	hotkeys_load_bindings(bindings);
+	obs_data_release(bindings);
+}
+
+bool hotkeys_allow(int hotkey)
+{
+	if(hotkey < 0 || hotkey >= hotkey_count)
+	{
+		return false;
+	}
+	hotkey_entry &entry = hotkeys[hotkey];
+	uint64_t now = os_gettime_ns();
+	uint64_t last = entry.last_fired_ns.load(std::memory_order_relaxed);
+	//held or bouncing keys, and two presses racing for the same slot
+	if((last && now - last < entry.min_interval_ns.load(std::memory_order_relaxed)) ||
+		!entry.last_fired_ns.compare_exchange_strong(last, now, std::memory_order_relaxed))
+	{
+		stats_hotkey_limited();
+		return false;
+	}
+	return true;
+}
+
+const char *hotkeys_name(int hotkey)
+{
+	return hotkey >= 0 && hotkey < hotkey_count ? hotkeys[hotkey].name.c_str() : "";
+}
+
+void hotkeys_save_bindings(obs_data_t *save_data)
+{
+	obs_data_t *bindings = obs_data_create();
+	for(int i = 0; i < hotkey_count; i++)
+	{
+		if(hotkeys[i].id == OBS_INVALID_HOTKEY_ID)
+		{
+			continue;
+		}
+		obs_data_array_t *keys = obs_hotkey_save(hotkeys[i].id);
+		if(keys)
+		{
+			obs_data_set_array(bindings, hotkeys[i].name.c_str(), keys);
+			obs_data_array_release(keys);
+		}
+	}
+	obs_data_set_obj(save_data, "SRBeep_hotkeys", bindings);
+	obs_data_release(bindings);
+}
+
+void hotkeys_load_bindings(obs_data_t *save_data)
+{
+	obs_data_t *bindings = obs_data_get_obj(save_data, "SRBeep_hotkeys");
+	if(!bindings)
+	{
+		return;
+	}
+	for(int i = 0; i < hotkey_count; i++)
+	{
+		obs_data_array_t *keys = obs_data_get_array(bindings, hotkeys[i].name.c_str());
+		if(keys && hotkeys[i].id != OBS_INVALID_HOTKEY_ID)
+		{
+			obs_hotkey_load(hotkeys[i].id, keys);
+		}
+		obs_data_array_release(keys);
+	}
+	obs_data_release(bindings);
+}
+
+void hotkeys_free(void)
+{
+	//once unregistered OBS won't call the hotkey again, so the slot can be reused
+	for(int i = 0; i < hotkey_count; i++)
+	{
+		if(hotkeys[i].id != OBS_INVALID_HOTKEY_ID)
+		{
+			obs_hotkey_unregister(hotkeys[i].id);
+		}
+		hotkeys[i].id = OBS_INVALID_HOTKEY_ID;
+	}
+	hotkey_count = 0;
+}
@@ -0,0 +1,21 @@
+/***********************************
+A Docile Sloth adocilesloth@gmail.com
+************************************/
+
+#pragma once
+
+#include <obs.h>
+
+//Frontend hotkeys for the "hotkeys" settings array, one per entry and in the
+//same order as cue_registry_pick_hotkey. Register and save on the UI thread.
+
+//Registers the hotkeys the settings ask for, keeping the bindings of any
+//that stay. func gets the hotkey index as its data.
+void hotkeys_update(obs_data_t *settings, obs_hotkey_func func);
+//Per hotkey rate limit, false if it fired too recently
+bool hotkeys_allow(int hotkey);
+const char *hotkeys_name(int hotkey);
+//Key bindings go in the scene collection next to the settings
+void hotkeys_save_bindings(obs_data_t *save_data);
+void hotkeys_load_bindings(obs_data_t *save_data);
+void hotkeys_free(void);
@@ -0,0 +1,240 @@
+/***********************************
+A Docile Sloth adocilesloth@gmail.com
+************************************/
+
+#include "milestones.h"
+#include "timer-wheel.h"
+#include <util/platform.h>
+#include <string.h>
+#include <mutex>
+
+#define MILESTONE_MAX 16
+
+struct milestone
+{
+	milestone_output output;
+	uint64_t every_ms;			//0 for a one off
+	uint64_t at_ms;
+	uint64_t next_ms;			//elapsed time it's next due at
+	bool done;
+	wheel_timer timer;
+};
+
+struct milestone_clock
+{
+	bool running;
+	bool paused;
+	uint64_t started_ns;
+	uint64_t paused_ns;			//when the current pause began
+	uint64_t paused_total_ns;
+	milestone_func fire;
+};
+
+static std::mutex milestone_mutex;
+static milestone milestones[MILESTONE_MAX];
+static int milestone_count = 0;
+static milestone_clock clocks[MILESTONE_OUTPUT_COUNT];
+
+static const cue_event milestone_events[MILESTONE_OUTPUT_COUNT] =
+{
+	CUE_RECORD_MILESTONE,
+	CUE_STREAM_MILESTONE
+};
+
+//Expects milestone_mutex to be held
+static uint64_t elapsed_ms(const milestone_clock &clock)
+{
+	uint64_t now = clock.paused ? clock.paused_ns : os_gettime_ns();
+	return (now - clock.started_ns - clock.paused_total_ns) / 1000000;
+}
+
+//Expects milestone_mutex to be held, picks the first due time after elapsed
+static void arm_milestone(milestone &entry, uint64_t elapsed)
+{
+	if(entry.every_ms)
+	{
+		entry.next_ms = (elapsed / entry.every_ms + 1) * entry.every_ms;
+		entry.done = false;
+	}
+	else
+	{
+		entry.next_ms = entry.at_ms;
+		entry.done = entry.at_ms <= elapsed;
+	}
+	if(!entry.done)
+	{
+		wheel_timer_schedule(&entry.timer, entry.next_ms - elapsed);
+	}
+}
+
+//Runs on the timer wheel thread
+static void milestone_due(void *data)
+{
+	milestone &entry = *(milestone*)data;
+	milestone_func fire = NULL;
+	cue_event event = CUE_EVENT_COUNT;
+	{
+		std::lock_guard<std::mutex> lock(milestone_mutex);
+		milestone_clock &clock = clocks[entry.output];
+		//a stop, pause or reload got in after the timer was taken off the wheel
+		if(!clock.running || clock.paused || entry.done)
+		{
+			return;
+		}
+		uint64_t elapsed = elapsed_ms(clock);
+		if(elapsed < entry.next_ms)
+		{
+			wheel_timer_schedule(&entry.timer, entry.next_ms - elapsed);
+			return;
+		}
+		fire = clock.fire;
+		event = milestone_events[entry.output];
+		arm_milestone(entry, elapsed);
+	}
+	if(fire)
+	{
+		fire(event);
+	}
+}
+
+void milestones_load_settings(obs_data_t *settings)
+{
+	std::lock_guard<std::mutex> lock(milestone_mutex);
+	for(int i = 0; i < milestone_count; i++)
+	{
+		wheel_timer_cancel(&milestones[i].timer);
+	}
+	milestone_count = 0;
+
+	obs_data_array_t *array = obs_data_get_array(settings, "milestones");
+	size_t count = obs_data_array_count(array);
+	for(size_t i = 0; i < count; i++)
+	{
+		obs_data_t *item = obs_data_array_item(array, i);
+		const char *output = obs_data_get_string(item, "output");
+		double every_min = obs_data_get_double(item, "every_min");
+		double at_min = obs_data_get_double(item, "at_min");
+		obs_data_release(item);
+
+		milestone_output which;
+		if(strcmp(output, "recording") == 0)
+		{
+			which = MILESTONE_RECORDING;
+		}
+		else if(strcmp(output, "streaming") == 0)
+		{
+			which = MILESTONE_STREAMING;
+		}
+		else
+		{
+			blog(LOG_WARNING, "SRBeep: milestones_load_settings: unknown output \"%s\"", output);
+			continue;
+		}
+		//under a tick apart would just be noise
+		if(every_min * 60000.0 < TIMER_WHEEL_TICK_MS && at_min * 60000.0 < TIMER_WHEEL_TICK_MS)
+		{
+			blog(LOG_WARNING, "SRBeep: milestones_load_settings: milestone %d needs every_min or at_min", (int)i);
+			continue;
+		}
+		if(milestone_count == MILESTONE_MAX)
+		{
+			blog(LOG_WARNING, "SRBeep: milestones_load_settings: only the first %d milestones are used", MILESTONE_MAX);
+			break;
+		}
+
+		milestone &entry = milestones[milestone_count++];
+		entry.output = which;
+		entry.every_ms = every_min * 60000.0 >= TIMER_WHEEL_TICK_MS ? (uint64_t)(every_min * 60000.0) : 0;
+		entry.at_ms = entry.every_ms ? 0 : (uint64_t)(at_min * 60000.0);
+		entry.done = true;
+		wheel_timer_init(&entry.timer, milestone_due, &entry);
+		//a reload mid recording picks up from where it is now
+		milestone_clock &clock = clocks[which];
+		if(clock.running)
+		{
+			arm_milestone(entry, elapsed_ms(clock));
+			if(clock.paused)
+			{
+				wheel_timer_cancel(&entry.timer);
+			}
+		}
+	}
+	obs_data_array_release(array);
+}
+
+void milestones_start(milestone_output output, milestone_func fire)
+{
+	std::lock_guard<std::mutex> lock(milestone_mutex);
+	milestone_clock &clock = clocks[output];
+	clock.running = true;
+	clock.paused = false;
+	clock.started_ns = os_gettime_ns();
+	clock.paused_total_ns = 0;
+	clock.fire = fire;
+	for(int i = 0; i < milestone_count; i++)
+	{
+		if(milestones[i].output == output)
+		{
+			arm_milestone(milestones[i], 0);
+		}
+	}
+}
+
+void milestones_stop(milestone_output output)
+{
+	std::lock_guard<std::mutex> lock(milestone_mutex);
+	clocks[output].running = false;
+	for(int i = 0; i < milestone_count; i++)
+	{
+		if(milestones[i].output == output)
+		{
+			wheel_timer_cancel(&milestones[i].timer);
+			milestones[i].done = true;
+		}
+	}
+}
+
+void milestones_pause(milestone_output output, bool paused)
+{
+	std::lock_guard<std::mutex> lock(milestone_mutex);
+	milestone_clock &clock = clocks[output];
+	if(!clock.running || clock.paused == paused)
+	{
+		return;
+	}
+	if(paused)
+	{
+		clock.paused_ns = os_gettime_ns();
+		clock.paused = true;
+		//next_ms stays put, the timers are placed again on resume
+		for(int i = 0; i < milestone_count; i++)
+		{
+			if(milestones[i].output == output)
+			{
+				wheel_timer_cancel(&milestones[i].timer);
+			}
+		}
+		return;
+	}
+	clock.paused_total_ns += os_gettime_ns() - clock.paused_ns;
+	clock.paused = false;
+	uint64_t elapsed = elapsed_ms(clock);
+	for(int i = 0; i < milestone_count; i++)
+	{
+		milestone &entry = milestones[i];
+		if(entry.output == output && !entry.done)
+		{
+			wheel_timer_schedule(&entry.timer, entry.next_ms > elapsed ? entry.next_ms - elapsed : 0);
+		}
+	}
+}
+
+void milestones_shutdown(void)
+{
+	std::lock_guard<std::mutex> lock(milestone_mutex);
+	for(int output = 0; output < MILESTONE_OUTPUT_COUNT; output++)
+	{
+		clocks[output].running = false;
+	}
+	milestone_count = 0;
+}
@@ -0,0 +1,28 @@
+/***********************************
+A Docile Sloth adocilesloth@gmail.com
+************************************/
+
+#pragma once
+
+#include <obs.h>
+#include "cue-registry.h"
+
+//Elapsed time cues during a recording or stream, eg every 30 minutes or at
+//55 minutes for a stream booked to end at 60. Each milestone is a timer on the
+//timer wheel, recording time stops counting while it's paused.
+
+enum milestone_output
+{
+	MILESTONE_RECORDING,
+	MILESTONE_STREAMING,
+	MILESTONE_OUTPUT_COUNT
+};
+
+typedef void (*milestone_func)(cue_event event);
+
+void milestones_load_settings(obs_data_t *settings);
+void milestones_start(milestone_output output, milestone_func fire);
+void milestones_stop(milestone_output output);
+void milestones_pause(milestone_output output, bool paused);
+//Only at module unload, after the timer wheel has stopped
+void milestones_shutdown(void);
@@ -0,0 +1,351 @@
+/***********************************
+A Docile Sloth adocilesloth@gmail.com
+************************************/
+
+#include "mixer.h"
+#include "adpcm.h"
+#include "decoder.h"
+#include "ducking.h"
+#include "stats.h"
+#include "trace.h"
+#include <util/platform.h>
+#include <atomic>
+
+#define MIXER_CHUNK 256
+
+enum voice_state
+{
+	VOICE_FREE,
+	VOICE_CLAIMED,		//a submitter is filling it in
+	VOICE_ARMED,		//filled in and waiting for mixer_fire, the callback skips it
+	VOICE_PLAYING,		//owned by the audio callback
+	VOICE_DONE			//finished, the next submitter recycles it
+};
+
+struct mixer_voice
+{
+	std::atomic<int> state;
+	cue_ref cue;		//only touched by whoever claimed it, never by the callback
+	const int16_t *samples;
+	const adpcm_block *blocks;
+	uint32_t frames;
+	uint32_t position;
+	uint32_t decoded_block;		//which block block_pcm holds
+	int16_t block_pcm[ADPCM_BLOCK_FRAMES * CUE_CHANNELS];
+	float gain;
+	uint64_t trace_id;
+	uint64_t requested_ns;
+	bool audible;
+};
+
+static mixer_voice voices[MIXER_VOICES];
+
+//Asked for by mixer_fade_out, the rest is only touched by the audio callback
+static std::atomic<uint32_t> fade_request(0);
+static std::atomic<bool> fade_done(false);
+static uint32_t fade_total = 0;
+static uint32_t fade_left = 0;
+static bool fading = false;
+
+//Frees finished voices outside the audio callback, dropping the last
+//reference to a cue set can free a lot of memory
+static void recycle_voices(void)
+{
+	for(int i = 0; i < MIXER_VOICES; i++)
+	{
+		int expected = VOICE_DONE;
+		if(voices[i].state.compare_exchange_strong(expected, VOICE_CLAIMED, std::memory_order_acquire))
+		{
+			voices[i].cue = cue_ref();
+			voices[i].state.store(VOICE_FREE, std::memory_order_release);
+		}
+	}
+}
+
+static void prefault(const cue_pcm &pcm)
+{
+	//one read per page is enough to fault the whole cue in
+	const volatile uint8_t *bytes = pcm.blocks ? (const uint8_t*)pcm.blocks : (const uint8_t*)pcm.samples;
+	size_t count = pcm.blocks ? ((size_t)pcm.frames + ADPCM_BLOCK_FRAMES - 1) / ADPCM_BLOCK_FRAMES * sizeof(adpcm_block)
+		: (size_t)pcm.frames * CUE_CHANNELS * sizeof(int16_t);
+	uint8_t sink = 0;
+	for(size_t i = 0; i < count; i += 4096)
+	{
+		sink ^= bytes[i];
+	}
+	(void)sink;
+}
+
+//Where the voice's next frames are, decoding the block the read position has
+//reached if the cue is compressed. Trims take to what is contiguous there.
+static const int16_t *voice_frames(mixer_voice &voice, uint32_t *take)
+{
+	if(!voice.blocks)
+	{
+		return voice.samples + (size_t)voice.position * CUE_CHANNELS;
+	}
+	uint32_t block = voice.position / ADPCM_BLOCK_FRAMES;
+	uint32_t offset = voice.position % ADPCM_BLOCK_FRAMES;
+	if(block != voice.decoded_block)
+	{
+		uint64_t start_ns = os_gettime_ns();
+		adpcm_decode_block(voice.blocks[block], voice.block_pcm);
+		voice.decoded_block = block;
+		stats_adpcm_decode(os_gettime_ns() - start_ns);
+	}
+	if(*take > ADPCM_BLOCK_FRAMES - offset)
+	{
+		*take = ADPCM_BLOCK_FRAMES - offset;
+	}
+	return voice.block_pcm + (size_t)offset * CUE_CHANNELS;
+}
+
+//Claims a free voice and fills it in, leaving it CLAIMED
+static int claim_voice(const cue_ref &cue, uint32_t frames, float gain)
+{
+	recycle_voices();
+	for(int i = 0; i < MIXER_VOICES; i++)
+	{
+		int expected = VOICE_FREE;
+		if(!voices[i].state.compare_exchange_strong(expected, VOICE_CLAIMED, std::memory_order_acquire))
+		{
+			continue;
+		}
+		mixer_voice &voice = voices[i];
+		voice.cue = cue;
+		voice.samples = cue.pcm.samples;
+		voice.blocks = cue.pcm.blocks;
+		voice.decoded_block = UINT32_MAX;
+		voice.frames = frames;
+		voice.position = 0;
+		voice.gain = gain;
+		voice.audible = gain > 0.0f;
+		voice.trace_id = 0;
+		return i;
+	}
+	return -1;
+}
+
+int mixer_arm(const cue_ref &cue)
+{
+	trace_scope scope("arm");
+	prefault(cue.pcm);
+	int index = claim_voice(cue, cue.pcm.frames, cue.gain);
+	if(index >= 0)
+	{
+		voices[index].state.store(VOICE_ARMED, std::memory_order_release);
+	}
+	return index;
+}
+
+bool mixer_fire(int index, uint64_t requested_ns)
+{
+	if(index < 0 || index >= MIXER_VOICES)
+	{
+		return false;
+	}
+	mixer_voice &voice = voices[index];
+	//only the one who armed it fires or disarms it, so nothing else writes these
+	voice.requested_ns = requested_ns;
+	voice.trace_id = trace_async_begin("cue_playback");
+	int expected = VOICE_ARMED;
+	if(!voice.state.compare_exchange_strong(expected, VOICE_PLAYING, std::memory_order_acq_rel))
+	{
+		trace_async_end("cue_playback", voice.trace_id);
+		return false;
+	}
+	ducking_engage(CUE_SAMPLE_RATE);
+	return true;
+}
+
+void mixer_disarm(int index)
+{
+	if(index < 0 || index >= MIXER_VOICES)
+	{
+		return;
+	}
+	//recycled by the next submitter, off whatever thread this is
+	int expected = VOICE_ARMED;
+	voices[index].state.compare_exchange_strong(expected, VOICE_DONE, std::memory_order_acq_rel);
+}
+
+static bool start_voice(const cue_ref &cue, uint32_t frames, float gain, uint64_t requested_ns)
+{
+	int index = claim_voice(cue, frames, gain);
+	if(index < 0)
+	{
+		return false;
+	}
+	mixer_voice &voice = voices[index];
+	voice.requested_ns = requested_ns;
+	voice.trace_id = trace_async_begin(voice.audible ? "cue_playback" : "cue_warm_up");
+	if(voice.audible)
+	{
+		ducking_engage(CUE_SAMPLE_RATE);
+	}
+	voice.state.store(VOICE_PLAYING, std::memory_order_release);
+	return true;
+}
+
+bool mixer_play(const cue_ref &cue, uint64_t requested_ns)
+{
+	trace_scope scope("device_submit");
+	return start_voice(cue, cue.pcm.frames, cue.gain, requested_ns);
+}
+
+bool mixer_warm_up(const cue_ref &cue, uint32_t frames)
+{
+	prefault(cue.pcm);
+	return start_voice(cue, frames < cue.pcm.frames ? frames : cue.pcm.frames, 0.0f, os_gettime_ns());
+}
+
+int mixer_warming_up(void)
+{
+	//audible is only written while a voice is claimed, before it is set playing
+	int count = 0;
+	for(int i = 0; i < MIXER_VOICES; i++)
+	{
+		if(voices[i].state.load(std::memory_order_acquire) == VOICE_PLAYING && !voices[i].audible)
+		{
+			count++;
+		}
+	}
+	return count;
+}
+
+//Ramps the chunk down along the fade, once it's over every voice is stopped
+static void apply_fade(float *mix, uint32_t count)
+{
+	for(uint32_t frame = 0; frame < count; frame++)
+	{
+		float gain = fade_total ? (float)fade_left / fade_total : 0.0f;
+		for(int channel = 0; channel < CUE_CHANNELS; channel++)
+		{
+			mix[frame * CUE_CHANNELS + channel] *= gain;
+		}
+		if(fade_left)
+		{
+			fade_left--;
+		}
+	}
+	if(fade_left)
+	{
+		return;
+	}
+	for(int v = 0; v < MIXER_VOICES; v++)
+	{
+		mixer_voice &voice = voices[v];
+		if(voice.state.load(std::memory_order_acquire) == VOICE_PLAYING)
+		{
+			trace_async_end(voice.audible ? "cue_playback" : "cue_warm_up", voice.trace_id);
+			voice.state.store(VOICE_DONE, std::memory_order_release);
+		}
+	}
+	fade_done.store(true, std::memory_order_release);
+}
+
+bool mixer_render(int16_t *out, uint32_t frames)
+{
+	bool active = false;
+	float mix[MIXER_CHUNK * CUE_CHANNELS];
+
+	uint32_t requested = fade_request.exchange(0, std::memory_order_acq_rel);
+	if(requested)
+	{
+		fade_total = fade_left = requested;
+		fading = true;
+	}
+
+	for(uint32_t done = 0; done < frames; done += MIXER_CHUNK)
+	{
+		uint32_t count = frames - done < MIXER_CHUNK ? frames - done : MIXER_CHUNK;
+		for(uint32_t i = 0; i < count * CUE_CHANNELS; i++)
+		{
+			mix[i] = 0.0f;
+		}
+
+		for(int v = 0; v < MIXER_VOICES; v++)
+		{
+			mixer_voice &voice = voices[v];
+			if(voice.state.load(std::memory_order_acquire) != VOICE_PLAYING)
+			{
+				continue;
+			}
+			active = true;
+			if(voice.position == 0)
+			{
+				//the first frames are going out, so this is the cue's latency
+				stats_cue_latency(os_gettime_ns() - voice.requested_ns, voice.audible);
+			}
+			float gain = voice.gain;
+			uint32_t mixed = 0;
+			while(mixed < count && voice.position < voice.frames)
+			{
+				uint32_t remaining = voice.frames - voice.position;
+				uint32_t take = remaining < count - mixed ? remaining : count - mixed;
+				const int16_t *src = voice_frames(voice, &take);
+				float *dst = mix + (size_t)mixed * CUE_CHANNELS;
+				for(uint32_t i = 0; i < take * CUE_CHANNELS; i++)
+				{
+					dst[i] += src[i] * gain;
+				}
+				voice.position += take;
+				mixed += take;
+			}
+			if(voice.position >= voice.frames)
+			{
+				trace_async_end(voice.audible ? "cue_playback" : "cue_warm_up", voice.trace_id);
+				voice.state.store(VOICE_DONE, std::memory_order_release);
+			}
+		}
+
+		if(fading)
+		{
+			apply_fade(mix, count);
+		}
+
+		int16_t *dst = out + (size_t)done * CUE_CHANNELS;
+		for(uint32_t i = 0; i < count * CUE_CHANNELS; i++)
+		{
+			float value = mix[i];
+			value = value > 32767.0f ? 32767.0f : (value < -32768.0f ? -32768.0f : value);
+			dst[i] = (int16_t)value;
+		}
+	}
+
+	//the device's sample clock drives the ducking envelope
+	ducking_process(frames, active);
+	return active;
+}
+
+void mixer_fade_out(uint32_t ms, uint32_t timeout_ms)
+{
+	bool playing = false;
+	for(int i = 0; i < MIXER_VOICES && !playing; i++)
+	{
+		playing = voices[i].state.load(std::memory_order_acquire) == VOICE_PLAYING;
+	}
+	if(!playing)
+	{
+		return;
+	}
+	uint32_t frames = ms * CUE_SAMPLE_RATE / 1000;
+	fade_done.store(false, std::memory_order_release);
+	fade_request.store(frames ? frames : 1, std::memory_order_release);
+	uint64_t give_up_ns = os_gettime_ns() + (uint64_t)timeout_ms * 1000000;
+	while(!fade_done.load(std::memory_order_acquire) && os_gettime_ns() < give_up_ns)
+	{
+		os_sleep_ms(1);
+	}
+}
+
+void mixer_clear(void)
+{
+	for(int i = 0; i < MIXER_VOICES; i++)
+	{
+		voices[i].cue = cue_ref();
+		voices[i].state.store(VOICE_FREE, std::memory_order_release);
+	}
+	fade_request.store(0, std::memory_order_release);
+	fading = false;
+}
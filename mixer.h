@@ -0,0 +1,36 @@
+/***********************************
+A Docile Sloth adocilesloth@gmail.com
+************************************/
+
+#pragma once
+
+#include <stdint.h>
+#include "cue-registry.h"
+
+#define MIXER_VOICES 16
+
+//Queues a cue on a free voice, false if every voice is busy.
+//Safe from any thread, never blocks on the audio callback. requested_ns is
+//when the event came in, for the latency stats.
+bool mixer_play(const cue_ref &cue, uint64_t requested_ns);
+//Faults the cue's pages in and runs its first frames through a voice at zero
+//gain, so the first audible cue finds everything warm. Doesn't duck.
+bool mixer_warm_up(const cue_ref &cue, uint32_t frames);
+//Voices still playing a warm up, so warm ups can go in batches
+int mixer_warming_up(void);
+//Takes a voice for a cue that is about to be needed, with its pages faulted
+//in, but keeps it silent. Returns the voice or -1 if every voice is busy.
+int mixer_arm(const cue_ref &cue);
+//Starts an armed voice, a single flag flip. False if it was disarmed.
+bool mixer_fire(int voice, uint64_t requested_ns);
+//Gives an armed voice back without playing it
+void mixer_disarm(int voice);
+//Audio callback side, renders frames of cue format into out. True if any
+//voice played.
+bool mixer_render(int16_t *out, uint32_t frames);
+//Fades every playing voice out over ms and stops it, for unload. Returns at
+//once if nothing is playing, otherwise waits for the audio callback to finish
+//the fade but never longer than timeout_ms.
+void mixer_fade_out(uint32_t ms, uint32_t timeout_ms);
+//Drops every voice, call with the device stopped
+void mixer_clear(void);
@@ -0,0 +1,296 @@
+/***********************************
+A Docile Sloth adocilesloth@gmail.com
+************************************/
+
+#include "resampler.h"
+#include "decoder.h"
+#include <atomic>
+#include <math.h>
+#include <string.h>
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+	#include <xmmintrin.h>
+	#define RESAMPLER_SSE
+#endif
+
+#ifndef M_PI
+	#define M_PI 3.14159265358979323846
+#endif
+
+#define RESAMPLER_MAX_PHASES 1024	//awkward ratios round to the nearest of this many phases
+
+struct quality_params
+{
+	int taps;			//multiple of 4 for the vector loop
+	double rolloff;		//passband edge as a fraction of the lower nyquist
+	double beta;		//kaiser window
+};
+
+static const quality_params quality_table[] =
+{
+	{16, 0.85, 6.0},	//RESAMPLER_FAST
+	{32, 0.91, 8.0},	//RESAMPLER_MEDIUM
+	{64, 0.95, 10.0},	//RESAMPLER_BEST
+};
+
+static std::atomic<int> default_quality(RESAMPLER_MEDIUM);
+
+void resampler_set_quality(resampler_quality quality)
+{
+	default_quality = quality;
+}
+
+static uint32_t gcd(uint32_t a, uint32_t b)
+{
+	while(b)
+	{
+		uint32_t t = a % b;
+		a = b;
+		b = t;
+	}
+	return a;
+}
+
+//Zeroth order modified bessel function, for the kaiser window
+static double bessel_i0(double x)
+{
+	double sum = 1.0;
+	double term = 1.0;
+	for(int k = 1; k < 32; k++)
+	{
+		term *= (x / (2 * k)) * (x / (2 * k));
+		sum += term;
+	}
+	return sum;
+}
+
+//phases rows of taps coefficients. Row p filters output time index + p / phases,
+//tap k sits on input frame index + k, the centre falls between taps/2-1 and taps/2.
+static std::vector<float> build_table(int in_rate, int out_rate, uint32_t phases, const quality_params &quality)
+{
+	std::vector<float> table((size_t)phases * quality.taps);
+	double cutoff = 0.5 * quality.rolloff * (out_rate < in_rate ? (double)out_rate / in_rate : 1.0);
+	double half = quality.taps / 2.0;
+	double window_norm = bessel_i0(quality.beta);
+
+	for(uint32_t p = 0; p < phases; p++)
+	{
+		double frac = (double)p / phases;
+		double sum = 0.0;
+		float *row = &table[(size_t)p * quality.taps];
+		for(int k = 0; k < quality.taps; k++)
+		{
+			double x = (k - (half - 1)) - frac;		//distance from the output time in input frames
+			double arg = 2.0 * cutoff * x;
+			double sinc = fabs(arg) < 1e-12 ? 1.0 : sin(M_PI * arg) / (M_PI * arg);
+			double w = x / half;
+			double window = fabs(w) >= 1.0 ? 0.0 : bessel_i0(quality.beta * sqrt(1.0 - w * w)) / window_norm;
+			row[k] = (float)(2.0 * cutoff * sinc * window);
+			sum += row[k];
+		}
+		for(int k = 0; k < quality.taps; k++)
+		{
+			row[k] = (float)(row[k] / sum);	//unity gain at dc for every phase
+		}
+	}
+	return table;
+}
+
+//Tables for the ratios cues actually come in at are built once and shared
+template<int IN_RATE, int OUT_RATE, int QUALITY>
+struct polyphase_table
+{
+	static const float *get(void)
+	{
+		static const std::vector<float> table = build_table(IN_RATE, OUT_RATE,
+			OUT_RATE / gcd(IN_RATE, OUT_RATE), quality_table[QUALITY]);
+		return &table[0];
+	}
+};
+
+template<int IN_RATE, int OUT_RATE>
+static const float *shared_table_for(int quality)
+{
+	switch(quality)
+	{
+	case RESAMPLER_FAST:
+		return polyphase_table<IN_RATE, OUT_RATE, RESAMPLER_FAST>::get();
+	case RESAMPLER_BEST:
+		return polyphase_table<IN_RATE, OUT_RATE, RESAMPLER_BEST>::get();
+	default:
+		return polyphase_table<IN_RATE, OUT_RATE, RESAMPLER_MEDIUM>::get();
+	}
+}
+
+static const float *shared_table(int in_rate, int out_rate, int quality)
+{
+	if(out_rate != CUE_SAMPLE_RATE)
+	{
+		return NULL;
+	}
+	switch(in_rate)
+	{
+	case 44100:
+		return shared_table_for<44100, CUE_SAMPLE_RATE>(quality);
+	case 22050:
+		return shared_table_for<22050, CUE_SAMPLE_RATE>(quality);
+	case 32000:
+		return shared_table_for<32000, CUE_SAMPLE_RATE>(quality);
+	case 16000:
+		return shared_table_for<16000, CUE_SAMPLE_RATE>(quality);
+	default:
+		return NULL;
+	}
+}
+
+static inline float dot(const float *a, const float *b, int count)
+{
+#ifdef RESAMPLER_SSE
+	__m128 acc0 = _mm_setzero_ps();
+	__m128 acc1 = _mm_setzero_ps();
+	int i = 0;
+	for(; i + 8 <= count; i += 8)
+	{
+		acc0 = _mm_add_ps(acc0, _mm_mul_ps(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i)));
+		acc1 = _mm_add_ps(acc1, _mm_mul_ps(_mm_loadu_ps(a + i + 4), _mm_loadu_ps(b + i + 4)));
+	}
+	for(; i + 4 <= count; i += 4)
+	{
+		acc0 = _mm_add_ps(acc0, _mm_mul_ps(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i)));
+	}
+	acc0 = _mm_add_ps(acc0, acc1);
+	float lanes[4];
+	_mm_storeu_ps(lanes, acc0);
+	return (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+#else
+	float acc[4] = {0.0f, 0.0f, 0.0f, 0.0f};
+	for(int i = 0; i < count; i += 4)
+	{
+		acc[0] += a[i] * b[i];
+		acc[1] += a[i + 1] * b[i + 1];
+		acc[2] += a[i + 2] * b[i + 2];
+		acc[3] += a[i + 3] * b[i + 3];
+	}
+	return (acc[0] + acc[1]) + (acc[2] + acc[3]);
+#endif
+}
+
+void resampler_init(resampler *r, int in_rate, int out_rate)
+{
+	int quality = default_quality;
+	const quality_params &params = quality_table[quality];
+	uint32_t divisor = gcd(in_rate, out_rate);
+
+	r->in_rate = in_rate;
+	r->out_rate = out_rate;
+	r->up = out_rate / divisor;
+	r->down = in_rate / divisor;
+	r->phases = r->up < RESAMPLER_MAX_PHASES ? r->up : RESAMPLER_MAX_PHASES;
+	r->taps = params.taps;
+	r->table = shared_table(in_rate, out_rate, quality);
+	r->own_table.clear();
+	if(!r->table && in_rate != out_rate)
+	{
+		r->own_table = build_table(in_rate, out_rate, r->phases, params);
+		r->table = &r->own_table[0];
+	}
+
+	//taps/2-1 frames of silence so the first output lines up with the first input
+	r->history_frames = r->taps / 2 - 1;
+	r->history_stride = r->history_frames + 4096;
+	r->history.assign(r->history_stride * CUE_CHANNELS, 0.0f);
+	r->index = 0;
+	r->phase = 0;
+	r->frames_in = 0;
+	r->frames_out = 0;
+}
+
+static void append_history(resampler *r, const float *in, size_t frames)
+{
+	if(r->history_frames + frames > r->history_stride)
+	{
+		size_t stride = (r->history_frames + frames) * 2;
+		std::vector<float> grown(stride * CUE_CHANNELS, 0.0f);
+		for(int channel = 0; channel < CUE_CHANNELS; channel++)
+		{
+			memcpy(&grown[channel * stride], &r->history[channel * r->history_stride], r->history_frames * sizeof(float));
+		}
+		r->history.swap(grown);
+		r->history_stride = stride;
+	}
+	for(int channel = 0; channel < CUE_CHANNELS; channel++)
+	{
+		float *row = &r->history[channel * r->history_stride + r->history_frames];
+		for(size_t i = 0; i < frames; i++)
+		{
+			row[i] = in[i * CUE_CHANNELS + channel];
+		}
+	}
+	r->history_frames += frames;
+}
+
+//Runs the filter over whatever history is complete, then drops consumed frames
+static void run_filter(resampler *r, std::vector<float> &out, uint64_t limit)
+{
+	while(r->index + r->taps <= r->history_frames && r->frames_out < limit)
+	{
+		uint32_t row = r->phase;
+		if(r->phases != r->up)
+		{
+			//nearest row, the last one also takes phases just short of the next frame
+			row = (uint32_t)(((uint64_t)r->phase * r->phases + r->up / 2) / r->up);
+			row = row < r->phases ? row : r->phases - 1;
+		}
+		const float *coeffs = r->table + (size_t)row * r->taps;
+		for(int channel = 0; channel < CUE_CHANNELS; channel++)
+		{
+			out.push_back(dot(coeffs, &r->history[channel * r->history_stride + r->index], r->taps));
+		}
+		r->frames_out++;
+
+		r->phase += r->down;
+		r->index += r->phase / r->up;
+		r->phase %= r->up;
+	}
+
+	size_t consumed = r->index < r->history_frames ? r->index : r->history_frames;
+	if(consumed > 0)
+	{
+		for(int channel = 0; channel < CUE_CHANNELS; channel++)
+		{
+			float *row = &r->history[channel * r->history_stride];
+			memmove(row, row + consumed, (r->history_frames - consumed) * sizeof(float));
+		}
+		r->history_frames -= consumed;
+		r->index -= consumed;
+	}
+}
+
+void resampler_process(resampler *r, const float *in, size_t frames, std::vector<float> &out)
+{
+	if(frames == 0)
+	{
+		return;
+	}
+	if(r->in_rate == r->out_rate)
+	{
+		out.insert(out.end(), in, in + frames * CUE_CHANNELS);
+		return;
+	}
+	append_history(r, in, frames);
+	r->frames_in += frames;
+	run_filter(r, out, UINT64_MAX);
+}
+
+void resampler_flush(resampler *r, std::vector<float> &out)
+{
+	if(r->in_rate == r->out_rate || r->frames_in == 0)
+	{
+		return;
+	}
+	//pad with silence so the tail gets filtered, and stop at the exact output length
+	std::vector<float> silence((size_t)r->taps * CUE_CHANNELS, 0.0f);
+	append_history(r, &silence[0], r->taps);
+	uint64_t total = (r->frames_in * r->up + r->down - 1) / r->down;
+	run_filter(r, out, total);
+}
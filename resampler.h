@@ -0,0 +1,46 @@
+/***********************************
+A Docile Sloth adocilesloth@gmail.com
+************************************/
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+//Number of filter taps per output sample, more is cleaner and slower
+enum resampler_quality
+{
+	RESAMPLER_FAST,		//16 taps
+	RESAMPLER_MEDIUM,	//32 taps
+	RESAMPLER_BEST		//64 taps
+};
+
+//Streaming polyphase windowed sinc sample rate converter for interleaved
+//float in cue channel layout. Input can be fed in blocks of any size,
+//output is appended.
+struct resampler
+{
+	int in_rate;
+	int out_rate;
+	uint32_t up;			//out_rate / gcd
+	uint32_t down;			//in_rate / gcd
+	uint32_t phases;		//filter phases in the table, up or fewer for awkward ratios
+	int taps;
+	const float *table;		//phases * taps, shared for the common ratios
+	std::vector<float> own_table;
+	std::vector<float> history;	//planar, CUE_CHANNELS rows of history_stride frames
+	size_t history_stride;
+	size_t history_frames;
+	size_t index;			//history frame under the first tap of the next output
+	uint32_t phase;			//0..up-1
+	uint64_t frames_in;
+	uint64_t frames_out;
+};
+
+//Quality used by resamplers created after the call
+void resampler_set_quality(resampler_quality quality);
+
+void resampler_init(resampler *r, int in_rate, int out_rate);
+void resampler_process(resampler *r, const float *in, size_t frames, std::vector<float> &out);
+void resampler_flush(resampler *r, std::vector<float> &out);
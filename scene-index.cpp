@@ -0,0 +1,133 @@
+/***********************************
+A Docile Sloth adocilesloth@gmail.com
+************************************/
+
+#include "scene-index.h"
+#include "cue-registry.h"
+#include <obs-frontend-api/obs-frontend-api.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+struct scene_slot
+{
+	uint32_t hash;
+	uint32_t name;				//offset into scene_names
+	int entry;					//-1 for an empty slot
+};
+
+//Open addressing, linear probing, at most half full so probes stay short
+static std::vector<scene_slot> scene_table;
+static std::vector<char> scene_names;
+static uint32_t scene_mask = 0;
+static int scene_count = 0;
+
+//FNV-1a
+static uint32_t hash_name(const char *name)
+{
+	uint32_t hash = 2166136261u;
+	while(*name)
+	{
+		hash ^= (uint8_t)*name++;
+		hash *= 16777619u;
+	}
+	return hash;
+}
+
+static void insert_scene(const char *name, int entry)
+{
+	uint32_t hash = hash_name(name);
+	uint32_t slot = hash & scene_mask;
+	while(scene_table[slot].entry >= 0)
+	{
+		//a collection can't have two scenes with one name, but be safe
+		if(scene_table[slot].hash == hash && strcmp(&scene_names[scene_table[slot].name], name) == 0)
+		{
+			return;
+		}
+		slot = (slot + 1) & scene_mask;
+	}
+	scene_table[slot].hash = hash;
+	scene_table[slot].name = (uint32_t)scene_names.size();
+	scene_table[slot].entry = entry;
+	scene_names.insert(scene_names.end(), name, name + strlen(name) + 1);
+	scene_count++;
+}
+
+void scene_index_rebuild(obs_data_t *settings)
+{
+	//the storage is kept, a rebuild only allocates when the index grows
+	scene_names.clear();
+	scene_count = 0;
+
+	std::vector<std::string> wanted;
+	obs_data_array_t *array = obs_data_get_array(settings, "scenes");
+	size_t count = array ? obs_data_array_count(array) : 0;
+	for(size_t i = 0; i < count && i < CUE_MAX_SCENES; i++)
+	{
+		obs_data_t *item = obs_data_array_item(array, i);
+		wanted.push_back(obs_data_get_string(item, "scene"));
+		obs_data_release(item);
+	}
+	obs_data_array_release(array);
+	if(count > CUE_MAX_SCENES)
+	{
+		blog(LOG_WARNING, "SRBeep: scene_index_rebuild: only the first %d scenes are used", CUE_MAX_SCENES);
+	}
+
+	uint32_t size = 4;
+	while(size < wanted.size() * 2)
+	{
+		size *= 2;
+	}
+	scene_mask = size - 1;
+	scene_slot empty = {0, 0, -1};
+	scene_table.assign(size, empty);
+	if(wanted.empty())
+	{
+		return;
+	}
+
+	struct obs_frontend_source_list scenes = {};
+	obs_frontend_get_scenes(&scenes);
+	for(size_t i = 0; i < scenes.sources.num; i++)
+	{
+		const char *name = obs_source_get_name(scenes.sources.array[i]);
+		for(size_t entry = 0; name && entry < wanted.size(); entry++)
+		{
+			if(wanted[entry] == name)
+			{
+				insert_scene(name, (int)entry);
+				break;
+			}
+		}
+	}
+	obs_frontend_source_list_free(&scenes);
+}
+
+int scene_index_find(const char *scene_name)
+{
+	if(scene_count == 0 || !scene_name)
+	{
+		return -1;
+	}
+	uint32_t hash = hash_name(scene_name);
+	uint32_t slot = hash & scene_mask;
+	while(scene_table[slot].entry >= 0)
+	{
+		if(scene_table[slot].hash == hash && strcmp(&scene_names[scene_table[slot].name], scene_name) == 0)
+		{
+			return scene_table[slot].entry;
+		}
+		slot = (slot + 1) & scene_mask;
+	}
+	return -1;
+}
+
+void scene_index_free(void)
+{
+	std::vector<scene_slot>().swap(scene_table);
+	std::vector<char>().swap(scene_names);
+	scene_mask = 0;
+	scene_count = 0;
+}
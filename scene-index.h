@@ -0,0 +1,17 @@
+/***********************************
+A Docile Sloth adocilesloth@gmail.com
+************************************/
+
+#pragma once
+
+#include <obs.h>
+
+//Scene name to its entry in "scenes", so a scene change costs one hash lookup
+//and no allocation however many scenes the collection has. Only the scenes
+//that exist in the current collection are indexed. UI thread only.
+
+//Walks the collection's scenes, on SCENE_LIST_CHANGED, a collection change or new settings
+void scene_index_rebuild(obs_data_t *settings);
+//Index into "scenes", or -1 if the scene has no cue
+int scene_index_find(const char *scene_name);
+void scene_index_free(void);
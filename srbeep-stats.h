@@ -0,0 +1,70 @@
+/***********************************
+A Docile Sloth adocilesloth@gmail.com
+************************************/
+
+//Public interface for other plugins and scripts. SRBeep exports
+//srbeep_get_stats, so it can be looked up in the loaded module by name.
+
+#pragma once
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+//Slots reserved per event, in the order stream_start, stream_stop,
+//record_start, record_stop, buffer_start, buffer_stop, pause_start,
+//pause_stop, alarm_dropped_frames, alarm_congestion, alarm_recovered,
+//record_milestone, stream_milestone. New events only take the next slot.
+#define SRBEEP_STATS_MAX_EVENTS 32
+
+//Snapshot handed out by srbeep_get_stats. Counters only go up, the
+//gauges hold the value at the time of the snapshot. New fields are only
+//added at the end, so the layout of older ones never changes.
+struct srbeep_stats
+{
+	uint32_t size;					//set by the caller, see srbeep_get_stats
+	uint32_t event_count;			//events SRBeep counts, the slots past it stay 0
+	uint64_t cues_requested[SRBEEP_STATS_MAX_EVENTS];
+	uint64_t cues_played[SRBEEP_STATS_MAX_EVENTS];
+	uint64_t cues_missing;			//no sound loaded for the event
+	uint64_t cues_dropped;			//every voice was busy, or no device to play on
+	uint64_t device_failures;		//SDL audio could not be opened
+	uint64_t underruns;				//the device called back late while a cue played
+	uint64_t decodes;
+	uint64_t decode_failures;
+	uint64_t decode_ns_total;
+	uint64_t decode_ns_max;
+	uint64_t shared_cache_bytes;	//gauge, host wide cache
+	uint64_t cue_set_bytes;			//gauge, per process cue sets
+	uint64_t worker_queue_depth;	//gauge
+	uint64_t worker_queue_peak;
+	uint64_t decode_timeouts;		//gave up after the decode budget
+	uint64_t decode_oversize;		//longer than the cue length limit
+	uint64_t first_cue_latency_ns;	//event to first sample at the device, first audible cue
+	uint64_t cue_latency_ns_total;	//the same for every audible cue
+	uint64_t cue_latency_ns_max;
+	uint64_t cue_latency_count;
+	uint64_t warm_up_latency_ns;	//the first warm up cue, what the first cue would have paid
+	uint64_t hotkeys_pressed;
+	uint64_t hotkeys_limited;		//pressed again within the hotkey's min_interval_ms
+	uint64_t health_polls;
+	uint64_t health_alarms;
+	uint64_t health_alarms_suppressed;	//raised again within the cooldown
+	uint64_t compressed_bytes;		//gauge, the part of cue_set_bytes held as ADPCM
+	uint64_t compressed_pcm_bytes;	//gauge, what those cues would take as PCM
+	uint64_t adpcm_blocks_decoded;	//compressed cue blocks decoded by the audio callback
+	uint64_t adpcm_decode_ns_total;
+};
+
+//Fills in a snapshot, safe from any thread at any time. Set size to
+//sizeof(struct srbeep_stats) first; SRBeep fills in no more than that and
+//sets size to what it filled in, which is less when SRBeep is older than
+//this header. Fields past it are left as they were.
+void srbeep_get_stats(struct srbeep_stats *stats);
+
+#ifdef __cplusplus
+}
+#endif
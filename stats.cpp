@@ -0,0 +1,258 @@
+/***********************************
+A Docile Sloth adocilesloth@gmail.com
+************************************/
+
+#include "stats.h"
+#include "cue-registry.h"
+#include <obs.h>
+#include <atomic>
+#include <string.h>
+
+static_assert(CUE_EVENT_COUNT <= SRBEEP_STATS_MAX_EVENTS, "cue_event has outgrown SRBEEP_STATS_MAX_EVENTS");
+
+static std::atomic<uint64_t> cues_requested[CUE_EVENT_COUNT];
+static std::atomic<uint64_t> cues_played[CUE_EVENT_COUNT];
+static std::atomic<uint64_t> cues_missing(0);
+static std::atomic<uint64_t> cues_dropped(0);
+static std::atomic<uint64_t> device_failures(0);
+static std::atomic<uint64_t> underruns(0);
+static std::atomic<uint64_t> decodes(0);
+static std::atomic<uint64_t> decode_failures(0);
+static std::atomic<uint64_t> decode_ns_total(0);
+static std::atomic<uint64_t> decode_ns_max(0);
+static std::atomic<uint64_t> shared_cache_bytes(0);
+static std::atomic<uint64_t> cue_set_bytes(0);
+static std::atomic<uint64_t> worker_queue_depth(0);
+static std::atomic<uint64_t> worker_queue_peak(0);
+static std::atomic<uint64_t> decode_timeouts(0);
+static std::atomic<uint64_t> decode_oversize(0);
+static std::atomic<uint64_t> first_cue_latency_ns(0);
+static std::atomic<uint64_t> cue_latency_ns_total(0);
+static std::atomic<uint64_t> cue_latency_ns_max(0);
+static std::atomic<uint64_t> cue_latency_count(0);
+static std::atomic<uint64_t> warm_up_latency_ns(0);
+static std::atomic<uint64_t> hotkeys_pressed(0);
+static std::atomic<uint64_t> hotkeys_limited(0);
+static std::atomic<uint64_t> health_polls(0);
+static std::atomic<uint64_t> health_alarms(0);
+static std::atomic<uint64_t> health_alarms_suppressed(0);
+static std::atomic<uint64_t> compressed_bytes(0);
+static std::atomic<uint64_t> compressed_pcm_bytes(0);
+static std::atomic<uint64_t> adpcm_blocks_decoded(0);
+static std::atomic<uint64_t> adpcm_decode_ns_total(0);
+
+static void raise_max(std::atomic<uint64_t> &max, uint64_t value)
+{
+	uint64_t current = max.load(std::memory_order_relaxed);
+	while(value > current && !max.compare_exchange_weak(current, value, std::memory_order_relaxed))
+	{
+	}
+}
+
+void stats_cue_requested(int event)
+{
+	if(event >= 0 && event < CUE_EVENT_COUNT)
+	{
+		cues_requested[event].fetch_add(1, std::memory_order_relaxed);
+	}
+}
+
+void stats_cue_played(int event)
+{
+	if(event >= 0 && event < CUE_EVENT_COUNT)
+	{
+		cues_played[event].fetch_add(1, std::memory_order_relaxed);
+	}
+}
+
+void stats_cue_missing(void)
+{
+	cues_missing.fetch_add(1, std::memory_order_relaxed);
+}
+
+void stats_cue_dropped(void)
+{
+	cues_dropped.fetch_add(1, std::memory_order_relaxed);
+}
+
+void stats_device_failure(void)
+{
+	device_failures.fetch_add(1, std::memory_order_relaxed);
+}
+
+void stats_underrun(void)
+{
+	underruns.fetch_add(1, std::memory_order_relaxed);
+}
+
+void stats_decode(uint64_t ns, bool ok)
+{
+	decodes.fetch_add(1, std::memory_order_relaxed);
+	if(!ok)
+	{
+		decode_failures.fetch_add(1, std::memory_order_relaxed);
+	}
+	decode_ns_total.fetch_add(ns, std::memory_order_relaxed);
+	raise_max(decode_ns_max, ns);
+}
+
+void stats_decode_timeout(void)
+{
+	decode_timeouts.fetch_add(1, std::memory_order_relaxed);
+}
+
+void stats_decode_oversize(void)
+{
+	decode_oversize.fetch_add(1, std::memory_order_relaxed);
+}
+
+void stats_cue_latency(uint64_t ns, bool audible)
+{
+	//0 means not seen yet, a real latency is never exactly 0
+	uint64_t unset = 0;
+	if(!audible)
+	{
+		warm_up_latency_ns.compare_exchange_strong(unset, ns, std::memory_order_relaxed);
+		return;
+	}
+	first_cue_latency_ns.compare_exchange_strong(unset, ns, std::memory_order_relaxed);
+	cue_latency_ns_total.fetch_add(ns, std::memory_order_relaxed);
+	cue_latency_count.fetch_add(1, std::memory_order_relaxed);
+	raise_max(cue_latency_ns_max, ns);
+}
+
+void stats_hotkey_pressed(void)
+{
+	hotkeys_pressed.fetch_add(1, std::memory_order_relaxed);
+}
+
+void stats_hotkey_limited(void)
+{
+	hotkeys_limited.fetch_add(1, std::memory_order_relaxed);
+}
+
+void stats_health_poll(void)
+{
+	health_polls.fetch_add(1, std::memory_order_relaxed);
+}
+
+void stats_health_alarm(bool fired)
+{
+	if(fired)
+		health_alarms.fetch_add(1, std::memory_order_relaxed);
+	else
+		health_alarms_suppressed.fetch_add(1, std::memory_order_relaxed);
+}
+
+void stats_adpcm_decode(uint64_t ns)
+{
+	adpcm_blocks_decoded.fetch_add(1, std::memory_order_relaxed);
+	adpcm_decode_ns_total.fetch_add(ns, std::memory_order_relaxed);
+}
+
+void stats_set_shared_cache_bytes(uint64_t bytes)
+{
+	shared_cache_bytes.store(bytes, std::memory_order_relaxed);
+}
+
+void stats_set_cue_set_bytes(uint64_t bytes)
+{
+	cue_set_bytes.store(bytes, std::memory_order_relaxed);
+}
+
+void stats_set_compressed_bytes(uint64_t bytes, uint64_t pcm_bytes)
+{
+	compressed_bytes.store(bytes, std::memory_order_relaxed);
+	compressed_pcm_bytes.store(pcm_bytes, std::memory_order_relaxed);
+}
+
+void stats_set_worker_queue_depth(uint64_t depth)
+{
+	worker_queue_depth.store(depth, std::memory_order_relaxed);
+	raise_max(worker_queue_peak, depth);
+}
+
+void stats_read(struct srbeep_stats *stats)
+{
+	memset(stats, 0, sizeof(*stats));
+	stats->size = sizeof(*stats);
+	stats->event_count = CUE_EVENT_COUNT;
+	for(int i = 0; i < CUE_EVENT_COUNT; i++)
+	{
+		stats->cues_requested[i] = cues_requested[i].load(std::memory_order_relaxed);
+		stats->cues_played[i] = cues_played[i].load(std::memory_order_relaxed);
+	}
+	stats->cues_missing = cues_missing.load(std::memory_order_relaxed);
+	stats->cues_dropped = cues_dropped.load(std::memory_order_relaxed);
+	stats->device_failures = device_failures.load(std::memory_order_relaxed);
+	stats->underruns = underruns.load(std::memory_order_relaxed);
+	stats->decodes = decodes.load(std::memory_order_relaxed);
+	stats->decode_failures = decode_failures.load(std::memory_order_relaxed);
+	stats->decode_ns_total = decode_ns_total.load(std::memory_order_relaxed);
+	stats->decode_ns_max = decode_ns_max.load(std::memory_order_relaxed);
+	stats->shared_cache_bytes = shared_cache_bytes.load(std::memory_order_relaxed);
+	stats->cue_set_bytes = cue_set_bytes.load(std::memory_order_relaxed);
+	stats->worker_queue_depth = worker_queue_depth.load(std::memory_order_relaxed);
+	stats->worker_queue_peak = worker_queue_peak.load(std::memory_order_relaxed);
+	stats->decode_timeouts = decode_timeouts.load(std::memory_order_relaxed);
+	stats->decode_oversize = decode_oversize.load(std::memory_order_relaxed);
+	stats->first_cue_latency_ns = first_cue_latency_ns.load(std::memory_order_relaxed);
+	stats->cue_latency_ns_total = cue_latency_ns_total.load(std::memory_order_relaxed);
+	stats->cue_latency_ns_max = cue_latency_ns_max.load(std::memory_order_relaxed);
+	stats->cue_latency_count = cue_latency_count.load(std::memory_order_relaxed);
+	stats->warm_up_latency_ns = warm_up_latency_ns.load(std::memory_order_relaxed);
+	stats->hotkeys_pressed = hotkeys_pressed.load(std::memory_order_relaxed);
+	stats->hotkeys_limited = hotkeys_limited.load(std::memory_order_relaxed);
+	stats->health_polls = health_polls.load(std::memory_order_relaxed);
+	stats->health_alarms = health_alarms.load(std::memory_order_relaxed);
+	stats->health_alarms_suppressed = health_alarms_suppressed.load(std::memory_order_relaxed);
+	stats->compressed_bytes = compressed_bytes.load(std::memory_order_relaxed);
+	stats->compressed_pcm_bytes = compressed_pcm_bytes.load(std::memory_order_relaxed);
+	stats->adpcm_blocks_decoded = adpcm_blocks_decoded.load(std::memory_order_relaxed);
+	stats->adpcm_decode_ns_total = adpcm_decode_ns_total.load(std::memory_order_relaxed);
+}
+
+void stats_log(void)
+{
+	struct srbeep_stats stats;
+	stats_read(&stats);
+
+	uint64_t requested = 0;
+	uint64_t played = 0;
+	for(int i = 0; i < CUE_EVENT_COUNT; i++)
+	{
+		requested += stats.cues_requested[i];
+		played += stats.cues_played[i];
+		if(stats.cues_requested[i])
+		{
+			blog(LOG_INFO, "SRBeep: stats: %s requested %llu played %llu", cue_event_key((cue_event)i),
+				(unsigned long long)stats.cues_requested[i], (unsigned long long)stats.cues_played[i]);
+		}
+	}
+	blog(LOG_INFO, "SRBeep: stats: cues requested %llu played %llu missing %llu dropped %llu device failures %llu underruns %llu",
+		(unsigned long long)requested, (unsigned long long)played, (unsigned long long)stats.cues_missing,
+		(unsigned long long)stats.cues_dropped, (unsigned long long)stats.device_failures, (unsigned long long)stats.underruns);
+	blog(LOG_INFO, "SRBeep: stats: decodes %llu failed %llu timed out %llu too long %llu average %.2f ms max %.2f ms",
+		(unsigned long long)stats.decodes, (unsigned long long)stats.decode_failures,
+		(unsigned long long)stats.decode_timeouts, (unsigned long long)stats.decode_oversize,
+		stats.decodes ? stats.decode_ns_total / 1e6 / stats.decodes : 0.0, stats.decode_ns_max / 1e6);
+	blog(LOG_INFO, "SRBeep: stats: hotkeys pressed %llu rate limited %llu",
+		(unsigned long long)stats.hotkeys_pressed, (unsigned long long)stats.hotkeys_limited);
+	blog(LOG_INFO, "SRBeep: stats: health polls %llu alarms %llu suppressed %llu",
+		(unsigned long long)stats.health_polls, (unsigned long long)stats.health_alarms,
+		(unsigned long long)stats.health_alarms_suppressed);
+	blog(LOG_INFO, "SRBeep: stats: cue latency first %.2f ms average %.2f ms max %.2f ms, first warm up %.2f ms",
+		stats.first_cue_latency_ns / 1e6,
+		stats.cue_latency_count ? stats.cue_latency_ns_total / 1e6 / stats.cue_latency_count : 0.0,
+		stats.cue_latency_ns_max / 1e6, stats.warm_up_latency_ns / 1e6);
+	blog(LOG_INFO, "SRBeep: stats: shared cache %llu KiB cue sets %llu KiB worker queue %llu peak %llu",
+		(unsigned long long)(stats.shared_cache_bytes / 1024), (unsigned long long)(stats.cue_set_bytes / 1024),
+		(unsigned long long)stats.worker_queue_depth, (unsigned long long)stats.worker_queue_peak);
+	if(stats.compressed_bytes || stats.adpcm_blocks_decoded)
+	{
+		blog(LOG_INFO, "SRBeep: stats: compressed cues %llu KiB (%llu KiB as PCM) blocks decoded %llu average %.2f us",
+			(unsigned long long)(stats.compressed_bytes / 1024), (unsigned long long)(stats.compressed_pcm_bytes / 1024),
+			(unsigned long long)stats.adpcm_blocks_decoded,
+			stats.adpcm_blocks_decoded ? stats.adpcm_decode_ns_total / 1e3 / stats.adpcm_blocks_decoded : 0.0);
+	}
+}
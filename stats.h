@@ -0,0 +1,34 @@
+/***********************************
+A Docile Sloth adocilesloth@gmail.com
+************************************/
+
+#pragma once
+
+//Internal side, records the counters srbeep_get_stats hands out
+#include "srbeep-stats.h"
+
+//Recording never blocks or allocates, safe from the audio callback
+void stats_cue_requested(int event);
+void stats_cue_played(int event);
+void stats_cue_missing(void);
+void stats_cue_dropped(void);
+void stats_device_failure(void);
+void stats_underrun(void);
+void stats_decode(uint64_t ns, bool ok);
+void stats_decode_timeout(void);
+void stats_decode_oversize(void);
+void stats_cue_latency(uint64_t ns, bool audible);
+void stats_hotkey_pressed(void);
+void stats_hotkey_limited(void);
+void stats_health_poll(void);
+void stats_health_alarm(bool fired);
+void stats_adpcm_decode(uint64_t ns);
+void stats_set_shared_cache_bytes(uint64_t bytes);
+void stats_set_cue_set_bytes(uint64_t bytes);
+void stats_set_compressed_bytes(uint64_t bytes, uint64_t pcm_bytes);
+void stats_set_worker_queue_depth(uint64_t depth);
+
+//The whole snapshot, with size and event_count filled in
+void stats_read(struct srbeep_stats *stats);
+//Writes the snapshot to the OBS log
+void stats_log(void);
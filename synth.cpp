@@ -0,0 +1,332 @@
+/***********************************
+A Docile Sloth adocilesloth@gmail.com
+************************************/
+
+#include "synth.h"
+#include "decoder.h"
+#include <obs.h>
+#include <ctype.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+	#include <emmintrin.h>
+	#define SYNTH_SSE
+#endif
+
+#define SYNTH_PREFIX "synth:"
+#define SYNTH_BLOCK 256			//oscillator block, the phase is only float inside one
+#define SYNTH_MAX_MS 60000.0f
+#define SYNTH_MAX_TONES 16
+#define SYNTH_DEFAULT_GAIN 0.5f
+#define SYNTH_DEFAULT_RAMP_MS 5.0f
+
+struct dtmf_pair
+{
+	char digit;
+	float low;
+	float high;
+};
+
+static const dtmf_pair dtmf_table[] =
+{
+	{'1', 697, 1209}, {'2', 697, 1336}, {'3', 697, 1477}, {'A', 697, 1633},
+	{'4', 770, 1209}, {'5', 770, 1336}, {'6', 770, 1477}, {'B', 770, 1633},
+	{'7', 852, 1209}, {'8', 852, 1336}, {'9', 852, 1477}, {'C', 852, 1633},
+	{'*', 941, 1209}, {'0', 941, 1336}, {'#', 941, 1477}, {'D', 941, 1633},
+};
+
+//sin(2*pi*x) for x in [0, 1), folded into a quarter cycle for the polynomial
+static inline float sin_cycles(float x)
+{
+	x -= 0.5f;								//sin(2pi(x + 0.5)) = -sin(2pi x)
+	float a = fabsf(x);
+	float r = a > 0.25f ? 0.5f - a : a;		//fold into [0, 0.25]
+	float z = 6.28318531f * copysignf(r, x);
+	float z2 = z * z;
+	float s = z * (1.0f + z2 * (-1.0f / 6 + z2 * (1.0f / 120 + z2 * (-1.0f / 5040 + z2 * (1.0f / 362880)))));
+	return -s;
+}
+
+#ifdef SYNTH_SSE
+//sin_cycles on four lanes, the fold and the signs done with masks
+static inline __m128 sin_cycles_sse(__m128 x)
+{
+	const __m128 sign_mask = _mm_set1_ps(-0.0f);
+	x = _mm_sub_ps(x, _mm_set1_ps(0.5f));
+	__m128 a = _mm_andnot_ps(sign_mask, x);
+	__m128 fold = _mm_cmpgt_ps(a, _mm_set1_ps(0.25f));
+	__m128 r = _mm_or_ps(_mm_and_ps(fold, _mm_sub_ps(_mm_set1_ps(0.5f), a)), _mm_andnot_ps(fold, a));
+	__m128 z = _mm_or_ps(_mm_mul_ps(_mm_set1_ps(6.28318531f), r), _mm_and_ps(sign_mask, x));
+	__m128 z2 = _mm_mul_ps(z, z);
+	__m128 p = _mm_add_ps(_mm_set1_ps(-1.0f / 5040), _mm_mul_ps(z2, _mm_set1_ps(1.0f / 362880)));
+	p = _mm_add_ps(_mm_set1_ps(1.0f / 120), _mm_mul_ps(z2, p));
+	p = _mm_add_ps(_mm_set1_ps(-1.0f / 6), _mm_mul_ps(z2, p));
+	p = _mm_add_ps(_mm_set1_ps(1.0f), _mm_mul_ps(z2, p));
+	return _mm_xor_ps(_mm_mul_ps(z, p), sign_mask);
+}
+#endif
+
+//Adds one oscillator into out. Phase is kept in double at block starts and
+//in float inside the block, so long cues don't drift. Inside a block the
+//phase never goes negative, so truncating it is a floor.
+static void add_oscillator(float *out, size_t frames, double start_hz, double end_hz, float amplitude)
+{
+	double rate = CUE_SAMPLE_RATE;
+	double sweep = frames > 1 ? (end_hz - start_hz) / (frames - 1) : 0.0;	//hz per frame
+
+	for(size_t block = 0; block < frames; block += SYNTH_BLOCK)
+	{
+		size_t count = frames - block < SYNTH_BLOCK ? frames - block : SYNTH_BLOCK;
+		//phase in cycles at frame n is (f0 n + sweep n^2 / 2) / rate
+		double n0 = (double)block;
+		double base = (start_hz * n0 + 0.5 * sweep * n0 * n0) / rate;
+		base -= floor(base);
+		float f0 = (float)((start_hz + sweep * n0) / rate);
+		float half_sweep = (float)(0.5 * sweep / rate);
+		float *dst = out + block;
+		size_t i = 0;
+
+#ifdef SYNTH_SSE
+		const __m128 base4 = _mm_set1_ps((float)base);
+		const __m128 f04 = _mm_set1_ps(f0);
+		const __m128 half_sweep4 = _mm_set1_ps(half_sweep);
+		const __m128 amplitude4 = _mm_set1_ps(amplitude);
+		__m128 n = _mm_setr_ps(0.0f, 1.0f, 2.0f, 3.0f);
+		for(; i + 4 <= count; i += 4)
+		{
+			__m128 phase = _mm_add_ps(base4, _mm_mul_ps(n, _mm_add_ps(f04, _mm_mul_ps(half_sweep4, n))));
+			phase = _mm_sub_ps(phase, _mm_cvtepi32_ps(_mm_cvttps_epi32(phase)));
+			_mm_storeu_ps(dst + i, _mm_add_ps(_mm_loadu_ps(dst + i), _mm_mul_ps(amplitude4, sin_cycles_sse(phase))));
+			n = _mm_add_ps(n, _mm_set1_ps(4.0f));
+		}
+#endif
+		for(; i < count; i++)
+		{
+			float n = (float)i;
+			float phase = (float)base + n * (f0 + half_sweep * n);
+			phase -= (float)(int)phase;
+			dst[i] += amplitude * sin_cycles(phase);
+		}
+	}
+}
+
+static void apply_ramp(float *out, size_t frames, float ramp_ms)
+{
+	size_t ramp = (size_t)(ramp_ms * CUE_SAMPLE_RATE / 1000.0f);
+	if(ramp * 2 > frames)
+	{
+		ramp = frames / 2;
+	}
+	for(size_t i = 0; i < ramp; i++)
+	{
+		float gain = (float)i / ramp;
+		out[i] *= gain;
+		out[frames - 1 - i] *= gain;
+	}
+}
+
+static size_t ms_to_frames(float ms)
+{
+	return (size_t)(ms * CUE_SAMPLE_RATE / 1000.0f);
+}
+
+bool synth_is_spec(const char *name)
+{
+	return strncmp(name, SYNTH_PREFIX, strlen(SYNTH_PREFIX)) == 0;
+}
+
+static std::vector<std::string> split(const std::string &text, char separator)
+{
+	std::vector<std::string> parts;
+	size_t start = 0;
+	while(true)
+	{
+		size_t end = text.find(separator, start);
+		parts.push_back(text.substr(start, end - start));
+		if(end == std::string::npos)
+		{
+			return parts;
+		}
+		start = end + 1;
+	}
+}
+
+bool synth_parse(const char *spec, synth_params *params, std::vector<char> &digits)
+{
+	if(!synth_is_spec(spec))
+	{
+		return false;
+	}
+	std::vector<std::string> parts = split(spec + strlen(SYNTH_PREFIX), ':');
+	params->freqs.clear();
+	params->digits = NULL;
+	params->gap_ms = 0.0f;
+	params->gain = SYNTH_DEFAULT_GAIN;
+	params->ramp_ms = SYNTH_DEFAULT_RAMP_MS;
+
+	const std::string &type = parts[0];
+	if(type == "tone" && parts.size() == 3)
+	{
+		params->type = SYNTH_TONE;
+		params->freqs.push_back((float)atof(parts[1].c_str()));
+		params->duration_ms = (float)atof(parts[2].c_str());
+	}
+	else if(type == "chirp" && parts.size() == 4)
+	{
+		params->type = SYNTH_CHIRP;
+		params->freqs.push_back((float)atof(parts[1].c_str()));
+		params->freqs.push_back((float)atof(parts[2].c_str()));
+		params->duration_ms = (float)atof(parts[3].c_str());
+	}
+	else if(type == "multi" && parts.size() == 3)
+	{
+		params->type = SYNTH_MULTI_TONE;
+		std::vector<std::string> tones = split(parts[1], '+');
+		for(size_t i = 0; i < tones.size(); i++)
+		{
+			params->freqs.push_back((float)atof(tones[i].c_str()));
+		}
+		params->duration_ms = (float)atof(parts[2].c_str());
+		//each tone is a pass over the whole cue
+		if(tones.size() > SYNTH_MAX_TONES)
+		{
+			blog(LOG_WARNING, "SRBeep: synth_parse: More than %d tones in %s", SYNTH_MAX_TONES, spec);
+			return false;
+		}
+	}
+	else if(type == "dtmf" && (parts.size() == 3 || parts.size() == 4))
+	{
+		params->type = SYNTH_DTMF;
+		digits.assign(parts[1].begin(), parts[1].end());
+		digits.push_back('\0');
+		params->digits = &digits[0];
+		params->duration_ms = (float)atof(parts[2].c_str());
+		params->gap_ms = parts.size() == 4 ? (float)atof(parts[3].c_str()) : params->duration_ms / 2;
+	}
+	else
+	{
+		blog(LOG_WARNING, "SRBeep: synth_parse: Bad synth cue %s", spec);
+		return false;
+	}
+
+	for(size_t i = 0; i < params->freqs.size(); i++)
+	{
+		if(!(params->freqs[i] > 0.0f && params->freqs[i] < CUE_SAMPLE_RATE / 2))
+		{
+			blog(LOG_WARNING, "SRBeep: synth_parse: Bad frequency in %s", spec);
+			return false;
+		}
+	}
+	if(!(params->duration_ms > 0.0f && params->duration_ms <= SYNTH_MAX_MS) || params->gap_ms < 0.0f || params->gap_ms > SYNTH_MAX_MS)
+	{
+		blog(LOG_WARNING, "SRBeep: synth_parse: Bad duration in %s", spec);
+		return false;
+	}
+	return true;
+}
+
+static const dtmf_pair *find_dtmf(char digit)
+{
+	for(size_t i = 0; i < sizeof(dtmf_table) / sizeof(dtmf_table[0]); i++)
+	{
+		if(dtmf_table[i].digit == digit)
+		{
+			return &dtmf_table[i];
+		}
+	}
+	return NULL;
+}
+
+size_t synth_frames(const synth_params &params)
+{
+	size_t frames = ms_to_frames(params.duration_ms);
+	if(params.type != SYNTH_DTMF)
+	{
+		return frames;
+	}
+	size_t total = 0;
+	size_t gap = ms_to_frames(params.gap_ms);
+	for(const char *digit = params.digits; digit && *digit; digit++)
+	{
+		if(find_dtmf((char)toupper(*digit)))
+		{
+			total += (total ? gap : 0) + frames;
+		}
+	}
+	return total;
+}
+
+bool synth_render(const synth_params &params, std::vector<int16_t> &pcm)
+{
+	std::vector<float> mono;
+	size_t frames = ms_to_frames(params.duration_ms);
+
+	if(params.type == SYNTH_TONE || params.type == SYNTH_CHIRP || params.type == SYNTH_MULTI_TONE)
+	{
+		if(params.freqs.empty() || frames == 0)
+		{
+			return false;
+		}
+		mono.assign(frames, 0.0f);
+		if(params.type == SYNTH_CHIRP)
+		{
+			add_oscillator(&mono[0], frames, params.freqs[0], params.freqs.size() > 1 ? params.freqs[1] : params.freqs[0], 1.0f);
+		}
+		else
+		{
+			float amplitude = 1.0f / params.freqs.size();
+			for(size_t i = 0; i < params.freqs.size(); i++)
+			{
+				add_oscillator(&mono[0], frames, params.freqs[i], params.freqs[i], amplitude);
+			}
+		}
+		apply_ramp(&mono[0], frames, params.ramp_ms);
+	}
+	else if(params.type == SYNTH_DTMF)
+	{
+		size_t gap = ms_to_frames(params.gap_ms);
+		for(const char *digit = params.digits; digit && *digit; digit++)
+		{
+			const dtmf_pair *pair = find_dtmf((char)toupper(*digit));
+			if(!pair || frames == 0)
+			{
+				continue;
+			}
+			if(!mono.empty())
+			{
+				mono.resize(mono.size() + gap, 0.0f);
+			}
+			size_t start = mono.size();
+			mono.resize(start + frames, 0.0f);
+			add_oscillator(&mono[start], frames, pair->low, pair->low, 0.5f);
+			add_oscillator(&mono[start], frames, pair->high, pair->high, 0.5f);
+			apply_ramp(&mono[start], frames, params.ramp_ms);
+		}
+		if(mono.empty())
+		{
+			return false;
+		}
+	}
+
+	pcm.resize(mono.size() * CUE_CHANNELS);
+	for(size_t i = 0; i < mono.size(); i++)
+	{
+		int16_t sample = (int16_t)lrintf(mono[i] * params.gain * 32767.0f);
+		for(int channel = 0; channel < CUE_CHANNELS; channel++)
+		{
+			pcm[i * CUE_CHANNELS + channel] = sample;
+		}
+	}
+	return true;
+}
+
+bool synth_render_spec(const char *spec, std::vector<int16_t> &pcm)
+{
+	synth_params params;
+	std::vector<char> digits;
+	pcm.clear();
+	return synth_parse(spec, &params, digits) && synth_render(params, pcm);
+}
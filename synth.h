@@ -0,0 +1,41 @@
+/***********************************
+A Docile Sloth adocilesloth@gmail.com
+************************************/
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+enum synth_type
+{
+	SYNTH_TONE,
+	SYNTH_CHIRP,
+	SYNTH_MULTI_TONE,
+	SYNTH_DTMF
+};
+
+struct synth_params
+{
+	synth_type type;
+	std::vector<float> freqs;	//tone: 1, chirp: start and end, multi tone: all of them
+	const char *digits;			//dtmf only
+	float duration_ms;			//per digit for dtmf
+	float gap_ms;				//dtmf only
+	float gain;
+	float ramp_ms;				//fade in/out to avoid clicks
+};
+
+//Cue names starting with "synth:" are generated instead of decoded:
+//	synth:tone:<hz>:<ms>
+//	synth:chirp:<start hz>:<end hz>:<ms>
+//	synth:multi:<hz>+<hz>+...:<ms>
+//	synth:dtmf:<digits>:<ms>[:<gap ms>]
+bool synth_is_spec(const char *name);
+bool synth_parse(const char *spec, synth_params *params, std::vector<char> &digits);
+//How many frames synth_render will make, to check the limits before rendering
+size_t synth_frames(const synth_params &params);
+//Renders in cue format, CUE_CHANNELS interleaved at CUE_SAMPLE_RATE
+bool synth_render(const synth_params &params, std::vector<int16_t> &pcm);
+bool synth_render_spec(const char *spec, std::vector<int16_t> &pcm);
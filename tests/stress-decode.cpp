@@ -0,0 +1,186 @@
+/***********************************
+A Docile Sloth adocilesloth@gmail.com
+************************************/
+
+//Decodes the bundled sounds over and over, checking every decode stays inside
+//its budget, that decodes still return on time with a tiny budget, and that
+//the open files, heap and resident size don't grow across passes.
+//	make check	or	./tests/stress-decode [sound folder] [passes]
+
+#include "../decoder.h"
+#include "../stats.h"
+#include <obs-module.h>
+#include <util/platform.h>
+#include <dirent.h>
+#include <malloc.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <algorithm>
+#include <string>
+#include <vector>
+
+OBS_DECLARE_MODULE()
+
+#define STRESS_DEFAULT_PASSES 50
+//a decode checks its budget between packets, so it can run over by one packet
+#define STRESS_BUDGET_SLACK_MS 50
+#define STRESS_TINY_BUDGET_MS 1
+//allocator and FFmpeg caches settle in the first pass, past that nothing should grow
+#define STRESS_GROWTH_LIMIT (4 * 1024 * 1024)
+
+static int count_fds(void)
+{
+	int count = 0;
+	DIR *dir = opendir("/proc/self/fd");
+	if(!dir)
+	{
+		return -1;
+	}
+	while(struct dirent *entry = readdir(dir))
+	{
+		if(entry->d_name[0] != '.')
+		{
+			count++;
+		}
+	}
+	closedir(dir);
+	return count;
+}
+
+static long long resident_bytes(void)
+{
+	long long pages = 0;
+	FILE *file = fopen("/proc/self/statm", "r");
+	if(!file)
+	{
+		return -1;
+	}
+	if(fscanf(file, "%*s %lld", &pages) != 1)
+	{
+		pages = -1;
+	}
+	fclose(file);
+	return pages < 0 ? -1 : pages * sysconf(_SC_PAGESIZE);
+}
+
+static long long heap_bytes(void)
+{
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || __GLIBC_MINOR__ >= 33)
+	return (long long)mallinfo2().uordblks;
+#else
+	return -1;
+#endif
+}
+
+static std::vector<std::string> list_sounds(const std::string &folder)
+{
+	std::vector<std::string> sounds;
+	DIR *dir = opendir(folder.c_str());
+	if(!dir)
+	{
+		return sounds;
+	}
+	while(struct dirent *entry = readdir(dir))
+	{
+		size_t length = strlen(entry->d_name);
+		if(length > 4 && strcmp(entry->d_name + length - 4, ".mp3") == 0)
+		{
+			sounds.push_back(folder + "/" + entry->d_name);
+		}
+	}
+	closedir(dir);
+	std::sort(sounds.begin(), sounds.end());
+	return sounds;
+}
+
+//Decodes every sound once, false if one failed or ran over budget_ms
+static bool decode_pass(const std::vector<std::string> &sounds, uint32_t budget_ms, bool must_load)
+{
+	bool ok = true;
+	std::vector<int16_t> pcm;
+	for(size_t i = 0; i < sounds.size(); i++)
+	{
+		uint64_t start = os_gettime_ns();
+		bool loaded = load_clip(sounds[i].c_str(), pcm);
+		double took_ms = (os_gettime_ns() - start) / 1e6;
+		if(took_ms > budget_ms + STRESS_BUDGET_SLACK_MS)
+		{
+			fprintf(stderr, "stress-decode: %s took %.2f ms, budget %u ms\n", sounds[i].c_str(), took_ms, budget_ms);
+			ok = false;
+		}
+		if(must_load && !loaded)
+		{
+			fprintf(stderr, "stress-decode: %s failed to decode\n", sounds[i].c_str());
+			ok = false;
+		}
+	}
+	return ok;
+}
+
+int main(int argc, char **argv)
+{
+#ifdef SRBEEP_NO_FFMPEG
+	printf("stress-decode: built without FFmpeg, the bundled mp3s can't be decoded\n");
+	return 0;
+#endif
+	std::string folder = argc > 1 ? argv[1] : "resource";
+	int passes = argc > 2 ? atoi(argv[2]) : STRESS_DEFAULT_PASSES;
+	std::vector<std::string> sounds = list_sounds(folder);
+	if(sounds.empty())
+	{
+		fprintf(stderr, "stress-decode: no mp3s in %s\n", folder.c_str());
+		return 1;
+	}
+	bool ok = true;
+
+	decoder_set_limits(DECODE_DEFAULT_BUDGET_MS, DECODE_DEFAULT_MAX_SECONDS);
+	ok = decode_pass(sounds, DECODE_DEFAULT_BUDGET_MS, true) && ok;
+	int fds = count_fds();
+	long long resident = resident_bytes();
+	long long heap = heap_bytes();
+
+	for(int pass = 0; pass < passes; pass++)
+	{
+		ok = decode_pass(sounds, DECODE_DEFAULT_BUDGET_MS, true) && ok;
+	}
+
+	//every decode has to give up at the budget, whether it finishes or not
+	struct srbeep_stats before;
+	stats_read(&before);
+	decoder_set_limits(STRESS_TINY_BUDGET_MS, DECODE_DEFAULT_MAX_SECONDS);
+	for(int pass = 0; pass < passes; pass++)
+	{
+		ok = decode_pass(sounds, STRESS_TINY_BUDGET_MS, false) && ok;
+	}
+	decoder_set_limits(DECODE_DEFAULT_BUDGET_MS, DECODE_DEFAULT_MAX_SECONDS);
+	struct srbeep_stats after;
+	stats_read(&after);
+	ok = decode_pass(sounds, DECODE_DEFAULT_BUDGET_MS, true) && ok;
+
+	int fds_after = count_fds();
+	long long resident_after = resident_bytes();
+	long long heap_after = heap_bytes();
+	printf("stress-decode: %d passes over %zu sounds, %llu timed out at %d ms\n", passes, sounds.size(),
+		(unsigned long long)(after.decode_timeouts - before.decode_timeouts), STRESS_TINY_BUDGET_MS);
+	printf("stress-decode: fds %d -> %d, resident %lld -> %lld KiB, heap %lld -> %lld KiB\n", fds, fds_after,
+		resident / 1024, resident_after / 1024, heap / 1024, heap_after / 1024);
+	if(fds_after != fds)
+	{
+		fprintf(stderr, "stress-decode: leaked %d file descriptors\n", fds_after - fds);
+		ok = false;
+	}
+	if(resident_after - resident > STRESS_GROWTH_LIMIT)
+	{
+		fprintf(stderr, "stress-decode: resident size grew by %lld KiB\n", (resident_after - resident) / 1024);
+		ok = false;
+	}
+	if(heap >= 0 && heap_after - heap > STRESS_GROWTH_LIMIT)
+	{
+		fprintf(stderr, "stress-decode: heap grew by %lld KiB\n", (heap_after - heap) / 1024);
+		ok = false;
+	}
+	printf("stress-decode: %s\n", ok ? "passed" : "FAILED");
+	return ok ? 0 : 1;
+}
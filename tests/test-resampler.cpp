@@ -0,0 +1,267 @@
+/***********************************
+A Docile Sloth adocilesloth@gmail.com
+************************************/
+
+//Measures the resampler's THD+N on a sine at every quality and its
+//throughput on the bundled sounds, next to swr_convert when built with
+//FFmpeg. Fails if a quality is noisier than its limit, or if the best
+//quality is well behind swr's default.
+//	make check	or	./tests/test-resampler [sound folder]
+
+#include "../decoder.h"
+#include "../resampler.h"
+#include <obs-module.h>
+#include <util/platform.h>
+#include <dirent.h>
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#ifndef SRBEEP_NO_FFMPEG
+extern "C"
+{
+	#include "libswresample/swresample.h"
+};
+#endif
+
+OBS_DECLARE_MODULE()
+
+#ifndef M_PI
+	#define M_PI 3.14159265358979323846
+#endif
+
+#define TEST_TONE_HZ 997.0
+#define TEST_TONE_SECONDS 2
+#define TEST_BLOCK_FRAMES 1024
+//swr's default is a 32 tap filter with interpolated phases, best has twice the taps
+#define TEST_SWR_MARGIN_DB 6.0
+
+//THD+N each quality has to beat, in dB relative to the tone. Fast leaves
+//images of low rate input at about -62 dB, and on awkward ratios the 1024
+//phase rows hold every quality to about -88 dB.
+static const double quality_limits_db[] = {-58.0, -78.0, -85.0};
+static const char *quality_names[] = {"fast", "medium", "best"};
+//the shared tables, then ratios whose phases are rounded to the nearest table row
+static const int test_rates[] = {44100, 22050, 32000, 16000, 44056, 47999};
+
+static std::vector<float> make_tone(int rate, double freq, int seconds)
+{
+	std::vector<float> tone((size_t)rate * seconds * CUE_CHANNELS);
+	for(size_t frame = 0; frame < tone.size() / CUE_CHANNELS; frame++)
+	{
+		float value = (float)(0.5 * sin(2.0 * M_PI * freq * frame / rate));
+		for(int channel = 0; channel < CUE_CHANNELS; channel++)
+		{
+			tone[frame * CUE_CHANNELS + channel] = value;
+		}
+	}
+	return tone;
+}
+
+//Residual after fitting a sine of the known frequency, against the sine. The
+//first and last tenth of a second are left out for the filter's edges.
+static double thd_n_db(const std::vector<float> &pcm, int rate, double freq)
+{
+	size_t frames = pcm.size() / CUE_CHANNELS;
+	size_t skip = rate / 10;
+	if(frames <= skip * 2)
+	{
+		return 0.0;
+	}
+	//least squares fit of a*sin + b*cos + c
+	double m[3][4] = {{0}};
+	for(size_t i = skip; i < frames - skip; i++)
+	{
+		double w = 2.0 * M_PI * freq * i / rate;
+		double basis[3] = {sin(w), cos(w), 1.0};
+		double y = pcm[i * CUE_CHANNELS];
+		for(int row = 0; row < 3; row++)
+		{
+			for(int col = 0; col < 3; col++)
+			{
+				m[row][col] += basis[row] * basis[col];
+			}
+			m[row][3] += basis[row] * y;
+		}
+	}
+	for(int pivot = 0; pivot < 3; pivot++)
+	{
+		for(int row = 0; row < 3; row++)
+		{
+			if(row != pivot)
+			{
+				double factor = m[row][pivot] / m[pivot][pivot];
+				for(int col = pivot; col < 4; col++)
+				{
+					m[row][col] -= factor * m[pivot][col];
+				}
+			}
+		}
+	}
+	double a = m[0][3] / m[0][0];
+	double b = m[1][3] / m[1][1];
+	double c = m[2][3] / m[2][2];
+
+	double signal = 0.0;
+	double residual = 0.0;
+	for(size_t i = skip; i < frames - skip; i++)
+	{
+		double w = 2.0 * M_PI * freq * i / rate;
+		double fit = a * sin(w) + b * cos(w) + c;
+		double error = pcm[i * CUE_CHANNELS] - fit;
+		signal += fit * fit;
+		residual += error * error;
+	}
+	return 10.0 * log10((residual + 1e-30) / signal);
+}
+
+static std::vector<float> run_ours(const std::vector<float> &in, int in_rate, resampler_quality quality)
+{
+	resampler_set_quality(quality);
+	resampler r;
+	resampler_init(&r, in_rate, CUE_SAMPLE_RATE);
+	std::vector<float> out;
+	out.reserve((size_t)((double)in.size() * CUE_SAMPLE_RATE / in_rate) + 1024);
+	size_t frames = in.size() / CUE_CHANNELS;
+	for(size_t done = 0; done < frames; done += TEST_BLOCK_FRAMES)
+	{
+		size_t count = std::min((size_t)TEST_BLOCK_FRAMES, frames - done);
+		resampler_process(&r, &in[done * CUE_CHANNELS], count, out);
+	}
+	resampler_flush(&r, out);
+	return out;
+}
+
+#ifndef SRBEEP_NO_FFMPEG
+static std::vector<float> run_swr(const std::vector<float> &in, int in_rate)
+{
+	std::vector<float> out;
+	SwrContext *swr = swr_alloc_set_opts(NULL,
+		AV_CH_LAYOUT_STEREO, AV_SAMPLE_FMT_FLT, CUE_SAMPLE_RATE,
+		AV_CH_LAYOUT_STEREO, AV_SAMPLE_FMT_FLT, in_rate, 0, NULL);
+	if(!swr || swr_init(swr) < 0)
+	{
+		swr_free(&swr);
+		return out;
+	}
+	size_t frames = in.size() / CUE_CHANNELS;
+	std::vector<float> block;
+	for(size_t done = 0; done <= frames; done += TEST_BLOCK_FRAMES)
+	{
+		//the last round flushes
+		int count = done < frames ? (int)std::min((size_t)TEST_BLOCK_FRAMES, frames - done) : 0;
+		const uint8_t *src = count ? (const uint8_t*)&in[done * CUE_CHANNELS] : NULL;
+		block.resize((size_t)(swr_get_out_samples(swr, count) + 16) * CUE_CHANNELS);
+		uint8_t *dst = (uint8_t*)&block[0];
+		int converted = swr_convert(swr, &dst, (int)(block.size() / CUE_CHANNELS), src ? &src : NULL, count);
+		if(converted > 0)
+		{
+			out.insert(out.end(), block.begin(), block.begin() + (size_t)converted * CUE_CHANNELS);
+		}
+	}
+	swr_free(&swr);
+	return out;
+}
+#endif
+
+static std::vector<std::string> list_sounds(const std::string &folder)
+{
+	std::vector<std::string> sounds;
+	DIR *dir = opendir(folder.c_str());
+	if(!dir)
+	{
+		return sounds;
+	}
+	while(struct dirent *entry = readdir(dir))
+	{
+		size_t length = strlen(entry->d_name);
+		if(length > 4 && strcmp(entry->d_name + length - 4, ".mp3") == 0)
+		{
+			sounds.push_back(folder + "/" + entry->d_name);
+		}
+	}
+	closedir(dir);
+	std::sort(sounds.begin(), sounds.end());
+	return sounds;
+}
+
+//Seconds of audio converted per second, taken as 44.1kHz input
+static double speed(const std::vector<float> &in, double took_ns)
+{
+	return (double)in.size() / CUE_CHANNELS / 44100 / (took_ns / 1e9);
+}
+
+int main(int argc, char **argv)
+{
+	std::string folder = argc > 1 ? argv[1] : "resource";
+	bool ok = true;
+
+	for(size_t rate = 0; rate < sizeof(test_rates) / sizeof(test_rates[0]); rate++)
+	{
+		int in_rate = test_rates[rate];
+		std::vector<float> tone = make_tone(in_rate, TEST_TONE_HZ, TEST_TONE_SECONDS);
+#ifndef SRBEEP_NO_FFMPEG
+		double best_db = 0.0;
+#endif
+		for(int quality = RESAMPLER_FAST; quality <= RESAMPLER_BEST; quality++)
+		{
+			double db = thd_n_db(run_ours(tone, in_rate, (resampler_quality)quality), CUE_SAMPLE_RATE, TEST_TONE_HZ);
+			printf("test-resampler: %d Hz %s THD+N %.1f dB\n", in_rate, quality_names[quality], db);
+			if(db > quality_limits_db[quality])
+			{
+				fprintf(stderr, "test-resampler: %d Hz %s is over its %.0f dB limit\n", in_rate, quality_names[quality],
+					quality_limits_db[quality]);
+				ok = false;
+			}
+#ifndef SRBEEP_NO_FFMPEG
+			best_db = db;
+#endif
+		}
+#ifndef SRBEEP_NO_FFMPEG
+		double swr_db = thd_n_db(run_swr(tone, in_rate), CUE_SAMPLE_RATE, TEST_TONE_HZ);
+		printf("test-resampler: %d Hz swr THD+N %.1f dB\n", in_rate, swr_db);
+		if(best_db > swr_db + TEST_SWR_MARGIN_DB)
+		{
+			fprintf(stderr, "test-resampler: %d Hz best is %.1f dB behind swr\n", in_rate, best_db - swr_db);
+			ok = false;
+		}
+#endif
+	}
+
+	//the bundled sounds decode to 48kHz, they are only a realistic signal here
+	std::vector<float> in;
+	std::vector<std::string> sounds = list_sounds(folder);
+	std::vector<int16_t> pcm;
+	for(size_t i = 0; i < sounds.size(); i++)
+	{
+		if(load_clip(sounds[i].c_str(), pcm))
+		{
+			for(size_t s = 0; s < pcm.size(); s++)
+			{
+				in.push_back(pcm[s] / 32768.0f);
+			}
+		}
+	}
+	if(in.empty())
+	{
+		printf("test-resampler: no sounds decoded from %s, timing a tone instead\n", folder.c_str());
+		in = make_tone(44100, TEST_TONE_HZ, 10);
+	}
+	for(int quality = RESAMPLER_FAST; quality <= RESAMPLER_BEST; quality++)
+	{
+		uint64_t start = os_gettime_ns();
+		run_ours(in, 44100, (resampler_quality)quality);
+		printf("test-resampler: %s %.0fx realtime\n", quality_names[quality], speed(in, (double)(os_gettime_ns() - start)));
+	}
+#ifndef SRBEEP_NO_FFMPEG
+	uint64_t start = os_gettime_ns();
+	run_swr(in, 44100);
+	printf("test-resampler: swr %.0fx realtime\n", speed(in, (double)(os_gettime_ns() - start)));
+#endif
+
+	printf("test-resampler: %s\n", ok ? "passed" : "FAILED");
+	return ok ? 0 : 1;
+}
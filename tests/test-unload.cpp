@@ -0,0 +1,161 @@
+/***********************************
+A Docile Sloth adocilesloth@gmail.com
+************************************/
+
+//Unloads the module while a cue is playing and a long decode is running on
+//the worker, failing if obs_module_unload goes over its deadline. Uses SDL's
+//dummy audio driver unless SDL_AUDIODRIVER says otherwise.
+//	make check	or	./tests/test-unload
+
+#include "../audio-output.h"
+#include "../decoder.h"
+#include "../mixer.h"
+#include "../synth.h"
+#include "../timer-wheel.h"
+#include "../worker.h"
+#include <obs-module.h>
+#include <util/platform.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <atomic>
+#include <string>
+#include <vector>
+
+#define UNLOAD_TEST_DEADLINE_MS 50
+//at 44.1kHz so the load resamples, long enough that it can't finish first
+#define UNLOAD_TEST_WAV_RATE 44100
+#define UNLOAD_TEST_WAV_SECONDS 300
+#define UNLOAD_TEST_START_TIMEOUT_MS 5000
+
+static std::atomic<bool> decode_started(false);
+static std::atomic<bool> decode_finished(false);
+
+static void put_u32(FILE *file, uint32_t value)
+{
+	uint8_t bytes[4] = {(uint8_t)value, (uint8_t)(value >> 8), (uint8_t)(value >> 16), (uint8_t)(value >> 24)};
+	fwrite(bytes, 1, 4, file);
+}
+
+static void put_u16(FILE *file, uint16_t value)
+{
+	uint8_t bytes[2] = {(uint8_t)value, (uint8_t)(value >> 8)};
+	fwrite(bytes, 1, 2, file);
+}
+
+//Stereo 16bit wav of low level noise
+static bool write_wav(const std::string &path)
+{
+	FILE *file = fopen(path.c_str(), "wb");
+	if(!file)
+	{
+		return false;
+	}
+	uint32_t frames = UNLOAD_TEST_WAV_RATE * UNLOAD_TEST_WAV_SECONDS;
+	uint32_t data_size = frames * 4;
+	fwrite("RIFF", 1, 4, file);
+	put_u32(file, 36 + data_size);
+	fwrite("WAVEfmt ", 1, 8, file);
+	put_u32(file, 16);
+	put_u16(file, 1);
+	put_u16(file, 2);
+	put_u32(file, UNLOAD_TEST_WAV_RATE);
+	put_u32(file, UNLOAD_TEST_WAV_RATE * 4);
+	put_u16(file, 4);
+	put_u16(file, 16);
+	fwrite("data", 1, 4, file);
+	put_u32(file, data_size);
+
+	std::vector<int16_t> chunk(UNLOAD_TEST_WAV_RATE * 2);
+	uint32_t seed = 1;
+	for(uint32_t second = 0; second < UNLOAD_TEST_WAV_SECONDS; second++)
+	{
+		for(size_t i = 0; i < chunk.size(); i++)
+		{
+			seed = seed * 1664525 + 1013904223;
+			chunk[i] = (int16_t)((seed >> 16) & 0x3ff) - 512;
+		}
+		fwrite(&chunk[0], sizeof(int16_t), chunk.size(), file);
+	}
+	return fclose(file) == 0;
+}
+
+int main(void)
+{
+	setenv("SDL_AUDIODRIVER", "dummy", 0);
+	const char *tmp = getenv("TMPDIR");
+	char name[64];
+	snprintf(name, sizeof(name), "/srbeep-unload-%d.wav", (int)getpid());
+	std::string wav_path = std::string(tmp && *tmp ? tmp : "/tmp") + name;
+	if(!write_wav(wav_path))
+	{
+		fprintf(stderr, "test-unload: can't write %s\n", wav_path.c_str());
+		return 1;
+	}
+
+	//what obs_module_load and the first cue bring up
+	timer_wheel_start();
+	worker_start();
+	if(!audio_output_start())
+	{
+		fprintf(stderr, "test-unload: can't open an audio device\n");
+		unlink(wav_path.c_str());
+		return 1;
+	}
+
+	std::vector<int16_t> tone;
+	if(!synth_render_spec("synth:tone:440:10000", tone))
+	{
+		fprintf(stderr, "test-unload: can't render the tone\n");
+		unlink(wav_path.c_str());
+		return 1;
+	}
+	cue_ref cue;
+	cue.pcm.samples = &tone[0];
+	cue.pcm.blocks = NULL;
+	cue.pcm.frames = (uint32_t)(tone.size() / CUE_CHANNELS);
+	cue.gain = 1.0f;
+	if(!mixer_play(cue, os_gettime_ns()))
+	{
+		fprintf(stderr, "test-unload: no voice for the tone\n");
+		unlink(wav_path.c_str());
+		return 1;
+	}
+
+	decoder_set_limits(60 * 1000, DECODE_MAX_SECONDS_CAP);
+	worker_post([wav_path]()
+	{
+		std::vector<int16_t> pcm;
+		decode_started.store(true);
+		load_clip(wav_path.c_str(), pcm);
+		decode_finished.store(true);
+	});
+	for(int waited = 0; !decode_started.load() && waited < UNLOAD_TEST_START_TIMEOUT_MS; waited++)
+	{
+		os_sleep_ms(1);
+	}
+	//let it get into the resampling
+	os_sleep_ms(20);
+
+	bool decoding = decode_started.load() && !decode_finished.load();
+	uint64_t start = os_gettime_ns();
+	obs_module_unload();
+	double took_ms = (os_gettime_ns() - start) / 1e6;
+	unlink(wav_path.c_str());
+
+	bool ok = true;
+	if(!decoding)
+	{
+		fprintf(stderr, "test-unload: the decode wasn't running at unload\n");
+		ok = false;
+	}
+	if(took_ms >= UNLOAD_TEST_DEADLINE_MS)
+	{
+		fprintf(stderr, "test-unload: unload took %.2f ms, deadline %d ms\n", took_ms, UNLOAD_TEST_DEADLINE_MS);
+		ok = false;
+	}
+	printf("test-unload: unload took %.2f ms\n", took_ms);
+	printf("test-unload: %s\n", ok ? "passed" : "FAILED");
+	return ok ? 0 : 1;
+}
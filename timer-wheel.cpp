@@ -0,0 +1,311 @@
+/***********************************
+A Docile Sloth adocilesloth@gmail.com
+************************************/
+
+#include "timer-wheel.h"
+#include "trace.h"
+#include <util/platform.h>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#define WHEEL_BITS 6
+#define WHEEL_SLOTS (1 << WHEEL_BITS)
+#define WHEEL_MASK (WHEEL_SLOTS - 1)
+#define WHEEL_LEVELS 4
+//about 46 hours at 10ms ticks, later timers wait in the top level and are placed again as it turns
+#define WHEEL_HORIZON ((uint64_t)1 << (WHEEL_BITS * WHEEL_LEVELS))
+#define TICK_NS ((uint64_t)TIMER_WHEEL_TICK_MS * 1000000)
+
+struct wheel_level
+{
+	wheel_timer *slots[WHEEL_SLOTS];
+	uint64_t occupied;		//bit per non empty slot
+};
+
+struct due_timer
+{
+	wheel_timer_func func;
+	void *data;
+};
+
+static std::mutex wheel_mutex;
+static std::condition_variable wheel_cv;
+static std::thread wheel_thread;
+static bool wheel_running = false;
+static wheel_level levels[WHEEL_LEVELS];
+static uint64_t base_ns = 0;
+static uint64_t current_tick = 0;		//the next tick to run
+static int pending_count = 0;
+
+static uint64_t now_tick(void)
+{
+	return (os_gettime_ns() - base_ns) / TICK_NS;
+}
+
+//Expects wheel_mutex to be held
+static void link_timer(wheel_timer *timer)
+{
+	uint64_t delta = timer->expires > current_tick ? timer->expires - current_tick : 0;
+	uint64_t place = delta < WHEEL_HORIZON ? current_tick + delta : current_tick + WHEEL_HORIZON - 1;
+	int level = 0;
+	while(level < WHEEL_LEVELS - 1 && place - current_tick >= ((uint64_t)1 << (WHEEL_BITS * (level + 1))))
+	{
+		level++;
+	}
+	int slot = (int)((place >> (WHEEL_BITS * level)) & WHEEL_MASK);
+
+	wheel_level &wheel = levels[level];
+	timer->prev = NULL;
+	timer->next = wheel.slots[slot];
+	if(timer->next)
+	{
+		timer->next->prev = timer;
+	}
+	wheel.slots[slot] = timer;
+	wheel.occupied |= (uint64_t)1 << slot;
+	timer->level = (uint8_t)level;
+	timer->slot = (uint8_t)slot;
+	timer->pending = true;
+	pending_count++;
+}
+
+//Expects wheel_mutex to be held
+static void unlink_timer(wheel_timer *timer)
+{
+	wheel_level &wheel = levels[timer->level];
+	if(timer->prev)
+	{
+		timer->prev->next = timer->next;
+	}
+	else
+	{
+		wheel.slots[timer->slot] = timer->next;
+	}
+	if(timer->next)
+	{
+		timer->next->prev = timer->prev;
+	}
+	if(!wheel.slots[timer->slot])
+	{
+		wheel.occupied &= ~((uint64_t)1 << timer->slot);
+	}
+	timer->next = timer->prev = NULL;
+	timer->pending = false;
+	pending_count--;
+}
+
+//Moves every timer in a higher level slot down to where it belongs now
+static void cascade(int level, int slot)
+{
+	wheel_timer *timer = levels[level].slots[slot];
+	while(timer)
+	{
+		wheel_timer *next = timer->next;
+		unlink_timer(timer);
+		link_timer(timer);
+		timer = next;
+	}
+}
+
+//Runs every tick up to and including target. Callbacks run without the lock,
+//so they can schedule, including themselves.
+static void run_due(std::unique_lock<std::mutex> &lock, uint64_t target)
+{
+	std::vector<due_timer> due;
+	while(current_tick <= target && wheel_running)
+	{
+		if(pending_count == 0)
+		{
+			current_tick = target + 1;
+			return;
+		}
+		uint64_t tick = current_tick;
+		int slot = (int)(tick & WHEEL_MASK);
+		//nothing in the bottom level, skip ahead to the next cascade
+		if(slot != 0 && !levels[0].occupied)
+		{
+			uint64_t boundary = (tick | WHEEL_MASK) + 1;
+			current_tick = boundary < target + 1 ? boundary : target + 1;
+			continue;
+		}
+
+		if(slot == 0)
+		{
+			//highest first, so their timers can land in the slots below
+			for(int level = WHEEL_LEVELS - 1; level > 0; level--)
+			{
+				uint64_t below = (uint64_t)1 << (WHEEL_BITS * level);
+				if((tick & (below - 1)) == 0)
+				{
+					cascade(level, (int)((tick >> (WHEEL_BITS * level)) & WHEEL_MASK));
+				}
+			}
+		}
+		current_tick = tick + 1;
+
+		due.clear();
+		wheel_timer *timer = levels[0].slots[slot];
+		while(timer)
+		{
+			wheel_timer *next = timer->next;
+			unlink_timer(timer);
+			if(timer->expires <= tick)
+			{
+				due_timer entry = {timer->func, timer->data};
+				due.push_back(entry);
+			}
+			else
+			{
+				link_timer(timer);
+			}
+			timer = next;
+		}
+		if(due.empty())
+		{
+			continue;
+		}
+		lock.unlock();
+		for(size_t i = 0; i < due.size(); i++)
+		{
+			trace_scope scope("timer");
+			due[i].func(due[i].data);
+		}
+		lock.lock();
+	}
+}
+
+//The next tick that has timers to run or a cascade to do
+static uint64_t next_wake_tick(void)
+{
+	//the current tick is a cascade that hasn't run yet
+	if((current_tick & WHEEL_MASK) == 0)
+	{
+		return current_tick;
+	}
+	uint64_t boundary = (current_tick | WHEEL_MASK) + 1;
+	uint64_t occupied = levels[0].occupied;
+	if(!occupied)
+	{
+		return boundary;
+	}
+	int slot = (int)(current_tick & WHEEL_MASK);
+	//rotate so the current slot is bit 0, the lowest set bit is then the nearest slot
+	uint64_t rotated = slot ? (occupied >> slot) | (occupied << (WHEEL_SLOTS - slot)) : occupied;
+	int ahead = 0;
+	while(!(rotated & 1))
+	{
+		rotated >>= 1;
+		ahead++;
+	}
+	uint64_t wake = current_tick + ahead;
+	return wake < boundary ? wake : boundary;
+}
+
+static void wheel_loop(void)
+{
+	trace_set_thread_name("SRBeep timers");
+	std::unique_lock<std::mutex> lock(wheel_mutex);
+	while(wheel_running)
+	{
+		run_due(lock, now_tick());
+		if(!wheel_running)
+		{
+			break;
+		}
+		if(pending_count == 0)
+		{
+			wheel_cv.wait(lock);
+			continue;
+		}
+		uint64_t wake_ns = base_ns + next_wake_tick() * TICK_NS;
+		uint64_t now = os_gettime_ns();
+		if(wake_ns > now)
+		{
+			wheel_cv.wait_for(lock, std::chrono::nanoseconds(wake_ns - now));
+		}
+	}
+}
+
+void timer_wheel_start(void)
+{
+	std::lock_guard<std::mutex> lock(wheel_mutex);
+	if(wheel_running)
+	{
+		return;
+	}
+	base_ns = os_gettime_ns();
+	current_tick = 0;
+	wheel_running = true;
+	wheel_thread = std::thread(wheel_loop);
+}
+
+void timer_wheel_stop(void)
+{
+	{
+		std::lock_guard<std::mutex> lock(wheel_mutex);
+		wheel_running = false;
+		for(int level = 0; level < WHEEL_LEVELS; level++)
+		{
+			for(int slot = 0; slot < WHEEL_SLOTS; slot++)
+			{
+				while(levels[level].slots[slot])
+				{
+					unlink_timer(levels[level].slots[slot]);
+				}
+			}
+		}
+	}
+	wheel_cv.notify_one();
+	if(wheel_thread.joinable())
+	{
+		wheel_thread.join();
+	}
+}
+
+void wheel_timer_init(wheel_timer *timer, wheel_timer_func func, void *data)
+{
+	timer->next = timer->prev = NULL;
+	timer->expires = 0;
+	timer->func = func;
+	timer->data = data;
+	timer->pending = false;
+	timer->level = timer->slot = 0;
+}
+
+void wheel_timer_schedule(wheel_timer *timer, uint64_t delay_ms)
+{
+	{
+		std::lock_guard<std::mutex> lock(wheel_mutex);
+		if(!wheel_running)
+		{
+			return;
+		}
+		if(timer->pending)
+		{
+			unlink_timer(timer);
+		}
+		//rounded up, a timer never runs early
+		uint64_t ticks = (delay_ms + TIMER_WHEEL_TICK_MS - 1) / TIMER_WHEEL_TICK_MS;
+		uint64_t now = now_tick();
+		if(pending_count == 0 && now > current_tick)
+		{
+			//the wheel was idle, nothing to cascade on the way
+			current_tick = now;
+		}
+		timer->expires = (now > current_tick ? now : current_tick) + ticks;
+		link_timer(timer);
+	}
+	wheel_cv.notify_one();
+}
+
+void wheel_timer_cancel(wheel_timer *timer)
+{
+	std::lock_guard<std::mutex> lock(wheel_mutex);
+	if(timer->pending)
+	{
+		unlink_timer(timer);
+	}
+}
@@ -0,0 +1,38 @@
+/***********************************
+A Docile Sloth adocilesloth@gmail.com
+************************************/
+
+#pragma once
+
+#include <stdint.h>
+
+//Hierarchical timer wheel driven by one thread, for everything SRBeep does on
+//a schedule. Timers are intrusive, so scheduling and cancelling are O(1) with
+//no allocation. The thread only wakes for the next due slot or a cascade,
+//never once per timer.
+
+typedef void (*wheel_timer_func)(void *data);
+
+struct wheel_timer
+{
+	wheel_timer *next;
+	wheel_timer *prev;
+	uint64_t expires;		//in ticks
+	wheel_timer_func func;
+	void *data;
+	bool pending;
+	uint8_t level;			//where it is linked, for the O(1) cancel
+	uint8_t slot;
+};
+
+#define TIMER_WHEEL_TICK_MS 10
+
+void timer_wheel_start(void);
+//Joins the thread, pending timers are dropped without running
+void timer_wheel_stop(void);
+
+void wheel_timer_init(wheel_timer *timer, wheel_timer_func func, void *data);
+//Arms or re-arms the timer to run delay_ms from now on the wheel thread
+void wheel_timer_schedule(wheel_timer *timer, uint64_t delay_ms);
+//Won't stop a callback that is already running, callbacks check their own state
+void wheel_timer_cancel(wheel_timer *timer);
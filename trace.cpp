@@ -0,0 +1,306 @@
+/***********************************
+A Docile Sloth adocilesloth@gmail.com
+************************************/
+
+#include "trace.h"
+#include <obs-module.h>
+#include <util/platform.h>
+#include <atomic>
+#include <stdio.h>
+#include <string>
+#include <time.h>
+#include <vector>
+
+#define TRACE_THREADS 16
+#define TRACE_BUFFER_EVENTS 8192		//a power of two, the ring index is a mask
+
+struct trace_event
+{
+	const char *name;
+	const char *detail;
+	uint64_t start_ns;
+	uint64_t end_ns;
+	uint64_t id;
+	char phase;			//'X' complete, 'b'/'e' async begin/end
+};
+
+//Written only by the thread that claimed it, read by trace_write. A ring of
+//the thread's latest events, older ones are overwritten.
+struct trace_buffer
+{
+	trace_event events[TRACE_BUFFER_EVENTS];
+	std::atomic<uint64_t> written;		//every event recorded, not just those still held
+	std::atomic<const char*> thread_name;
+};
+
+static_assert((TRACE_BUFFER_EVENTS & (TRACE_BUFFER_EVENTS - 1)) == 0, "TRACE_BUFFER_EVENTS must be a power of two");
+
+static std::atomic<bool> tracing(false);
+static std::atomic<trace_buffer*> trace_pool(NULL);
+static std::atomic<int> buffers_claimed(0);
+static std::atomic<uint32_t> threads_dropped(0);
+static std::atomic<uint64_t> next_async_id(1);
+//Bumped by trace_shutdown, so threads that outlive it don't keep a freed buffer
+static std::atomic<uint32_t> pool_generation(0);
+
+static thread_local trace_buffer *thread_buffer = NULL;
+static thread_local uint32_t thread_generation = 0;
+static thread_local const char *thread_name = NULL;
+
+void trace_set_enabled(bool enabled)
+{
+	if(enabled && !trace_pool.load(std::memory_order_acquire))
+	{
+		trace_buffer *pool = new trace_buffer[TRACE_THREADS];
+		for(int i = 0; i < TRACE_THREADS; i++)
+		{
+			pool[i].written = 0;
+			pool[i].thread_name = NULL;
+		}
+		trace_pool.store(pool, std::memory_order_release);
+	}
+	tracing.store(enabled, std::memory_order_release);
+}
+
+bool trace_enabled(void)
+{
+	return tracing.load(std::memory_order_relaxed);
+}
+
+void trace_set_thread_name(const char *name)
+{
+	if(thread_name == name)
+	{
+		return;
+	}
+	thread_name = name;
+	if(thread_buffer && thread_generation == pool_generation.load(std::memory_order_acquire))
+	{
+		thread_buffer->thread_name.store(name, std::memory_order_release);
+	}
+}
+
+static trace_buffer *claim_buffer(void)
+{
+	uint32_t generation = pool_generation.load(std::memory_order_acquire);
+	if(thread_buffer && thread_generation == generation)
+	{
+		return thread_buffer;
+	}
+	thread_buffer = NULL;
+	trace_buffer *pool = trace_pool.load(std::memory_order_acquire);
+	if(!pool)
+	{
+		return NULL;
+	}
+	int index = buffers_claimed.fetch_add(1, std::memory_order_relaxed);
+	if(index >= TRACE_THREADS)
+	{
+		return NULL;
+	}
+	thread_buffer = &pool[index];
+	thread_generation = generation;
+	thread_buffer->thread_name.store(thread_name, std::memory_order_release);
+	return thread_buffer;
+}
+
+static void record(char phase, const char *name, const char *detail, uint64_t start_ns, uint64_t end_ns, uint64_t id)
+{
+	if(!tracing.load(std::memory_order_relaxed))
+	{
+		return;
+	}
+	trace_buffer *buffer = claim_buffer();
+	if(!buffer)
+	{
+		threads_dropped.fetch_add(1, std::memory_order_relaxed);
+		return;
+	}
+	uint64_t written = buffer->written.load(std::memory_order_relaxed);
+	trace_event &event = buffer->events[written & (TRACE_BUFFER_EVENTS - 1)];
+	event.name = name;
+	event.detail = detail;
+	event.start_ns = start_ns;
+	event.end_ns = end_ns;
+	event.id = id;
+	event.phase = phase;
+	//publishes the event to trace_write
+	buffer->written.store(written + 1, std::memory_order_release);
+}
+
+void trace_complete(const char *name, const char *detail, uint64_t start_ns, uint64_t end_ns)
+{
+	record('X', name, detail, start_ns, end_ns, 0);
+}
+
+uint64_t trace_async_begin(const char *name)
+{
+	if(!tracing.load(std::memory_order_relaxed))
+	{
+		return 0;
+	}
+	uint64_t id = next_async_id.fetch_add(1, std::memory_order_relaxed);
+	uint64_t now = os_gettime_ns();
+	record('b', name, NULL, now, now, id);
+	return id;
+}
+
+void trace_async_end(const char *name, uint64_t id)
+{
+	if(id)
+	{
+		uint64_t now = os_gettime_ns();
+		record('e', name, NULL, now, now, id);
+	}
+}
+
+trace_scope::trace_scope(const char *name, const char *detail) : name(name), detail(detail)
+{
+	start_ns = trace_enabled() ? os_gettime_ns() : 0;
+}
+
+trace_scope::~trace_scope()
+{
+	if(start_ns)
+	{
+		trace_complete(name, detail, start_ns, os_gettime_ns());
+	}
+}
+
+//Names are ours, but details can be file or event names
+static void write_string(FILE *file, const char *text)
+{
+	fputc('"', file);
+	for(const char *c = text; *c; c++)
+	{
+		if(*c == '"' || *c == '\\')
+		{
+			fputc('\\', file);
+			fputc(*c, file);
+		}
+		else if((unsigned char)*c < 0x20)
+		{
+			fprintf(file, "\\u%04x", (unsigned)(unsigned char)*c);
+		}
+		else
+		{
+			fputc(*c, file);
+		}
+	}
+	fputc('"', file);
+}
+
+bool trace_write(void)
+{
+	trace_buffer *pool = trace_pool.load(std::memory_order_acquire);
+	if(!pool)
+	{
+		blog(LOG_WARNING, "SRBeep: trace_write: Tracing was never enabled, set \"trace_enabled\"");
+		return false;
+	}
+
+	char *folder = obs_module_config_path("");
+	if(folder)
+	{
+		os_mkdirs(folder);
+		bfree(folder);
+	}
+	char file_name[64];
+	snprintf(file_name, sizeof(file_name), "trace-%lld.json", (long long)time(NULL));
+	char *path = obs_module_config_path(file_name);
+	if(!path)
+	{
+		return false;
+	}
+	FILE *file = fopen(path, "w");
+	if(!file)
+	{
+		blog(LOG_WARNING, "SRBeep: trace_write: Can't open %s", path);
+		bfree(path);
+		return false;
+	}
+
+	//os_gettime_ns is in the same process for every thread, one pid will do
+	fprintf(file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+	bool first = true;
+	uint64_t written = 0;
+	uint64_t overwritten = 0;
+	uint64_t dropped = threads_dropped.load(std::memory_order_relaxed);
+	int claimed = buffers_claimed.load(std::memory_order_relaxed);
+	std::vector<trace_event> events;
+	for(int t = 0; t < TRACE_THREADS && t < claimed; t++)
+	{
+		trace_buffer &buffer = pool[t];
+		int tid = t + 1;
+		const char *name = buffer.thread_name.load(std::memory_order_acquire);
+		if(name)
+		{
+			fprintf(file, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":", first ? "" : ",\n", tid);
+			write_string(file, name);
+			fprintf(file, "}}");
+			first = false;
+		}
+
+		//copy the ring, then skip whatever its thread overwrote while we copied
+		uint64_t end = buffer.written.load(std::memory_order_acquire);
+		uint64_t start = end > TRACE_BUFFER_EVENTS ? end - TRACE_BUFFER_EVENTS : 0;
+		events.clear();
+		for(uint64_t i = start; i < end; i++)
+		{
+			events.push_back(buffer.events[i & (TRACE_BUFFER_EVENTS - 1)]);
+		}
+		std::atomic_thread_fence(std::memory_order_acquire);
+		uint64_t now = buffer.written.load(std::memory_order_relaxed);
+		uint64_t valid = now > TRACE_BUFFER_EVENTS ? now - TRACE_BUFFER_EVENTS : 0;
+		if(valid > end)
+		{
+			valid = end;
+		}
+		if(valid < start)
+		{
+			valid = start;
+		}
+		overwritten += valid;
+		for(size_t i = (size_t)(valid - start); i < events.size(); i++)
+		{
+			const trace_event &event = events[i];
+			fprintf(file, "%s{\"name\":", first ? "" : ",\n");
+			write_string(file, event.name);
+			fprintf(file, ",\"cat\":\"srbeep\",\"ph\":\"%c\",\"pid\":1,\"tid\":%d,\"ts\":%.3f", event.phase, tid, event.start_ns / 1000.0);
+			if(event.phase == 'X')
+			{
+				fprintf(file, ",\"dur\":%.3f", (event.end_ns - event.start_ns) / 1000.0);
+			}
+			else
+			{
+				fprintf(file, ",\"id\":%llu", (unsigned long long)event.id);
+			}
+			if(event.detail)
+			{
+				fprintf(file, ",\"args\":{\"detail\":");
+				write_string(file, event.detail);
+				fprintf(file, "}");
+			}
+			fprintf(file, "}");
+			first = false;
+			written++;
+		}
+	}
+	fprintf(file, "\n]}\n");
+	fclose(file);
+
+	blog(LOG_INFO, "SRBeep: trace_write: Wrote %llu events to %s, %llu overwritten, %llu dropped",
+		(unsigned long long)written, path, (unsigned long long)overwritten, (unsigned long long)dropped);
+	bfree(path);
+	return true;
+}
+
+void trace_shutdown(void)
+{
+	tracing = false;
+	pool_generation.fetch_add(1, std::memory_order_release);
+	trace_buffer *pool = trace_pool.exchange(NULL);
+	delete[] pool;
+	buffers_claimed = 0;
+	thread_buffer = NULL;
+}
@@ -0,0 +1,43 @@
+/***********************************
+A Docile Sloth adocilesloth@gmail.com
+************************************/
+
+#pragma once
+
+#include <stdint.h>
+
+//Opt in timeline of cue activity, written as Chrome Trace Event JSON that
+//chrome://tracing and Perfetto open. Timestamps come from os_gettime_ns, the
+//same clock as OBS's own profiler. Every thread records into its own fixed
+//ring, so recording never locks or allocates; a full ring overwrites its
+//oldest events.
+//Names and details must be string literals or otherwise live for the whole
+//session.
+
+void trace_set_enabled(bool enabled);
+bool trace_enabled(void);
+//Shows up as the thread's name in the viewer
+void trace_set_thread_name(const char *name);
+
+void trace_complete(const char *name, const char *detail, uint64_t start_ns, uint64_t end_ns);
+//A span that ends on another thread, eg a cue from submit to its last sample.
+//Returns the id to end it with, 0 when tracing is off.
+uint64_t trace_async_begin(const char *name);
+void trace_async_end(const char *name, uint64_t id);
+
+//Writes everything recorded so far to the plugin config folder
+bool trace_write(void);
+//Frees the buffers, only once no other thread can record
+void trace_shutdown(void);
+
+//Records a complete span for its own lifetime
+class trace_scope
+{
+public:
+	trace_scope(const char *name, const char *detail = 0);
+	~trace_scope();
+private:
+	const char *name;
+	const char *detail;
+	uint64_t start_ns;
+};
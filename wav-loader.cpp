@@ -0,0 +1,273 @@
+/***********************************
+A Docile Sloth adocilesloth@gmail.com
+************************************/
+
+#include "wav-loader.h"
+#include "decoder.h"
+#include "resampler.h"
+#include <obs.h>
+#include <limits.h>
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+#define WAV_FORMAT_PCM 1
+#define WAV_FORMAT_FLOAT 3
+#define WAV_FORMAT_EXTENSIBLE 0xFFFE
+#define WAV_MAX_CHANNELS 8
+#define WAV_BLOCK_FRAMES 4096
+
+struct wav_format
+{
+	int format;
+	int channels;
+	int sample_rate;
+	int bits;
+	int block_align;
+};
+
+static uint32_t read_le(const uint8_t *bytes, int count)
+{
+	uint32_t value = 0;
+	for(int i = count - 1; i >= 0; i--)
+	{
+		value = (value << 8) | bytes[i];
+	}
+	return value;
+}
+
+//One sample as float in [-1, 1]
+static float sample_to_float(const uint8_t *bytes, const wav_format &fmt)
+{
+	if(fmt.format == WAV_FORMAT_FLOAT)
+	{
+		uint32_t bits = read_le(bytes, 4);
+		float value;
+		memcpy(&value, &bits, sizeof(value));
+		return value;
+	}
+	switch(fmt.bits)
+	{
+	case 8:
+		return (bytes[0] - 128) / 128.0f;
+	case 16:
+		return (int16_t)read_le(bytes, 2) / 32768.0f;
+	case 24:
+		return (int32_t)(read_le(bytes, 3) << 8) / 2147483648.0f;
+	default:
+		return (int32_t)read_le(bytes, 4) / 2147483648.0f;
+	}
+}
+
+//Mono is copied to both sides, anything wider keeps front left/right
+static void to_cue_channels(const uint8_t *frame, const wav_format &fmt, float *out)
+{
+	int bytes = fmt.bits / 8;
+	float left = sample_to_float(frame, fmt);
+	float right = fmt.channels > 1 ? sample_to_float(frame + bytes, fmt) : left;
+	out[0] = left;
+	out[1] = right;
+}
+
+static void append_s16(const std::vector<float> &in, std::vector<int16_t> &pcm)
+{
+	size_t start = pcm.size();
+	pcm.resize(start + in.size());
+	for(size_t i = 0; i < in.size(); i++)
+	{
+		float value = in[i] * 32767.0f;
+		value = value > 32767.0f ? 32767.0f : (value < -32768.0f ? -32768.0f : value);
+		pcm[start + i] = (int16_t)lrintf(value);
+	}
+}
+
+static bool read_format(const uint8_t *chunk, uint32_t size, wav_format *fmt)
+{
+	if(size < 16)
+	{
+		return false;
+	}
+	fmt->format = read_le(chunk, 2);
+	fmt->channels = read_le(chunk + 2, 2);
+	fmt->sample_rate = read_le(chunk + 4, 4);
+	fmt->block_align = read_le(chunk + 12, 2);
+	fmt->bits = read_le(chunk + 14, 2);
+	if(fmt->format == WAV_FORMAT_EXTENSIBLE && size >= 26)
+	{
+		fmt->format = read_le(chunk + 24, 2);		//first bytes of the sub format GUID
+	}
+
+	bool pcm_ok = fmt->format == WAV_FORMAT_PCM && (fmt->bits == 8 || fmt->bits == 16 || fmt->bits == 24 || fmt->bits == 32);
+	bool float_ok = fmt->format == WAV_FORMAT_FLOAT && fmt->bits == 32;
+	return (pcm_ok || float_ok) &&
+		fmt->channels >= 1 && fmt->channels <= WAV_MAX_CHANNELS &&
+		fmt->sample_rate >= 1000 && fmt->sample_rate <= 384000 &&
+		fmt->block_align == fmt->channels * fmt->bits / 8;
+}
+
+bool wav_probe(const char *filepath)
+{
+	FILE *file = fopen(filepath, "rb");
+	if(!file)
+	{
+		return false;
+	}
+	uint8_t header[12];
+	bool is_wav = fread(header, 1, sizeof(header), file) == sizeof(header) &&
+		memcmp(header, "RIFF", 4) == 0 && memcmp(header + 8, "WAVE", 4) == 0;
+	fclose(file);
+	return is_wav;
+}
+
+bool wav_load(const char *filepath, std::vector<int16_t> &pcm, const decode_limits &limits)
+{
+	pcm.clear();
+	FILE *file = fopen(filepath, "rb");
+	if(!file)
+	{
+		blog(LOG_WARNING, "SRBeep: wav_load: Failed to open file %s", filepath);
+		return false;
+	}
+
+	uint8_t header[12];
+	if(fread(header, 1, sizeof(header), file) != sizeof(header) || memcmp(header, "RIFF", 4) != 0 || memcmp(header + 8, "WAVE", 4) != 0)
+	{
+		fclose(file);
+		blog(LOG_WARNING, "SRBeep: wav_load: %s is not a wav file", filepath);
+		return false;
+	}
+
+	//walk the chunks until the data, the format has to come first
+	wav_format fmt;
+	bool have_format = false;
+	uint32_t data_size = 0;
+	while(true)
+	{
+		uint8_t chunk_header[8];
+		if(fread(chunk_header, 1, sizeof(chunk_header), file) != sizeof(chunk_header))
+		{
+			fclose(file);
+			blog(LOG_WARNING, "SRBeep: wav_load: No data in %s", filepath);
+			return false;
+		}
+		uint32_t size = read_le(chunk_header + 4, 4);
+		if(memcmp(chunk_header, "fmt ", 4) == 0 && size <= 64)
+		{
+			uint8_t chunk[64];
+			if(fread(chunk, 1, size, file) != size || !read_format(chunk, size, &fmt))
+			{
+				fclose(file);
+				blog(LOG_WARNING, "SRBeep: wav_load: Unsupported format in %s", filepath);
+				return false;
+			}
+			have_format = true;
+			if(size & 1)
+				fseek(file, 1, SEEK_CUR);
+		}
+		else if(memcmp(chunk_header, "data", 4) == 0 && have_format)
+		{
+			data_size = size;
+			break;
+		}
+		//a long can be 32bit, a bogus size must not turn into a seek backwards
+		else if(size >= (uint32_t)LONG_MAX || fseek(file, (long)size + (size & 1), SEEK_CUR) != 0)
+		{
+			fclose(file);
+			blog(LOG_WARNING, "SRBeep: wav_load: Broken chunk in %s", filepath);
+			return false;
+		}
+	}
+
+	//reject a file that is too long before decoding any of it
+	uint64_t in_frames = data_size / fmt.block_align;
+	if(!decode_within(limits, (size_t)(in_frames * CUE_SAMPLE_RATE / fmt.sample_rate) * CUE_CHANNELS, filepath))
+	{
+		fclose(file);
+		return false;
+	}
+
+	resampler r;
+	resampler_init(&r, fmt.sample_rate, CUE_SAMPLE_RATE);
+	std::vector<uint8_t> block((size_t)WAV_BLOCK_FRAMES * fmt.block_align);
+	std::vector<float> frames(WAV_BLOCK_FRAMES * CUE_CHANNELS);
+	std::vector<float> out;
+
+	//a truncated data chunk just ends the cue early
+	uint32_t remaining = data_size;
+	while(remaining >= (uint32_t)fmt.block_align)
+	{
+		size_t want = remaining < block.size() ? remaining - remaining % fmt.block_align : block.size();
+		size_t got = fread(&block[0], 1, want, file);
+		size_t count = got / fmt.block_align;
+		if(count == 0)
+		{
+			break;
+		}
+		for(size_t i = 0; i < count; i++)
+		{
+			to_cue_channels(&block[i * fmt.block_align], fmt, &frames[i * CUE_CHANNELS]);
+		}
+		out.clear();
+		resampler_process(&r, &frames[0], count, out);
+		append_s16(out, pcm);
+		remaining -= (uint32_t)(count * fmt.block_align);
+		if(got < want)
+		{
+			break;
+		}
+		if(!decode_within(limits, pcm.size(), filepath))
+		{
+			fclose(file);
+			return false;
+		}
+	}
+	out.clear();
+	resampler_flush(&r, out);
+	append_s16(out, pcm);
+	fclose(file);
+	return !pcm.empty();
+}
+
+bool raw_load(const char *filepath, std::vector<int16_t> &pcm, const decode_limits &limits)
+{
+	pcm.clear();
+	FILE *file = fopen(filepath, "rb");
+	if(!file)
+	{
+		blog(LOG_WARNING, "SRBeep: raw_load: Failed to open file %s", filepath);
+		return false;
+	}
+
+	//the size is known up front, no need to read a file that is too long
+	if(fseek(file, 0, SEEK_END) == 0)
+	{
+		long size = ftell(file);
+		if(size > 0 && !decode_within(limits, (size_t)size / 2, filepath))
+		{
+			fclose(file);
+			return false;
+		}
+		fseek(file, 0, SEEK_SET);
+	}
+
+	uint8_t block[WAV_BLOCK_FRAMES * CUE_CHANNELS * 2];
+	size_t got;
+	while((got = fread(block, 1, sizeof(block), file)) >= 2)
+	{
+		if(!decode_within(limits, pcm.size() + got / 2, filepath))
+		{
+			fclose(file);
+			return false;
+		}
+		size_t start = pcm.size();
+		pcm.resize(start + got / 2);
+		for(size_t i = 0; i < got / 2; i++)
+		{
+			pcm[start + i] = (int16_t)read_le(block + i * 2, 2);
+		}
+	}
+	fclose(file);
+	//drop a trailing partial frame
+	pcm.resize(pcm.size() - pcm.size() % CUE_CHANNELS);
+	return !pcm.empty();
+}
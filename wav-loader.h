@@ -0,0 +1,20 @@
+/***********************************
+A Docile Sloth adocilesloth@gmail.com
+************************************/
+
+#pragma once
+
+#include <stdint.h>
+#include <vector>
+
+//Built in loaders that need no FFmpeg. Files are read in blocks and converted
+//to cue format as they stream in, checking the decode limits as they go.
+
+struct decode_limits;
+
+//True if the file starts with a RIFF/WAVE header
+bool wav_probe(const char *filepath);
+//PCM 8/16/24/32bit or float 32bit, any rate, any channel count
+bool wav_load(const char *filepath, std::vector<int16_t> &pcm, const decode_limits &limits);
+//Headerless signed 16bit little endian at CUE_SAMPLE_RATE with CUE_CHANNELS
+bool raw_load(const char *filepath, std::vector<int16_t> &pcm, const decode_limits &limits);
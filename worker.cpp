@@ -0,0 +1,93 @@
+/***********************************
+A Docile Sloth adocilesloth@gmail.com
+************************************/
+
+#include "worker.h"
+#include "stats.h"
+#include "trace.h"
+#include <util/platform.h>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+
+static std::thread worker_thread;
+static std::mutex worker_mutex;
+static std::condition_variable worker_cv;
+struct worker_task
+{
+	std::function<void()> run;
+	uint64_t posted_ns;		//for the queueing span
+};
+
+static std::deque<worker_task> worker_queue;
+static bool worker_running = false;
+
+static void worker_loop(void)
+{
+	trace_set_thread_name("SRBeep worker");
+	std::unique_lock<std::mutex> lock(worker_mutex);
+	while(true)
+	{
+		worker_cv.wait(lock, []{ return !worker_running || !worker_queue.empty(); });
+		if(!worker_running)
+		{
+			return;
+		}
+		worker_task task = worker_queue.front();
+		worker_queue.pop_front();
+		stats_set_worker_queue_depth(worker_queue.size());
+
+		lock.unlock();
+		if(task.posted_ns)
+		{
+			trace_complete("worker_queue", NULL, task.posted_ns, os_gettime_ns());
+		}
+		{
+			trace_scope scope("worker_task");
+			task.run();
+		}
+		lock.lock();
+	}
+}
+
+void worker_start(void)
+{
+	std::lock_guard<std::mutex> lock(worker_mutex);
+	if(worker_running)
+	{
+		return;
+	}
+	worker_running = true;
+	worker_thread = std::thread(worker_loop);
+}
+
+void worker_post(std::function<void()> task)
+{
+	std::lock_guard<std::mutex> lock(worker_mutex);
+	if(!worker_running)
+	{
+		return;
+	}
+	worker_task queued;
+	queued.run = task;
+	queued.posted_ns = trace_enabled() ? os_gettime_ns() : 0;
+	worker_queue.push_back(queued);
+	stats_set_worker_queue_depth(worker_queue.size());
+	worker_cv.notify_one();
+}
+
+void worker_stop(void)
+{
+	{
+		std::lock_guard<std::mutex> lock(worker_mutex);
+		worker_running = false;
+		worker_queue.clear();
+		stats_set_worker_queue_depth(0);
+	}
+	worker_cv.notify_one();
+	if(worker_thread.joinable())
+	{
+		worker_thread.join();
+	}
+}
@@ -0,0 +1,14 @@
+/***********************************
+A Docile Sloth adocilesloth@gmail.com
+************************************/
+
+#pragma once
+
+#include <functional>
+
+//A single background thread for slow work (decoding, prefetching cue sets)
+//so the frontend event callback never blocks on it. Tasks run in order.
+void worker_start(void);
+void worker_post(std::function<void()> task);
+//Drops queued tasks and joins after the running one finishes
+void worker_stop(void);